@@ -1,78 +1,215 @@
-/* huffMain.c 
- * Huffman Compression and Decompression 
- * Andrew Reder & Joshua Silva 
- * 
+/* huffMain.c
+ * Huffman Compression and Decompression
+ * Andrew Reder & Joshua Silva
+ *
  * Purpose: Handle Huffman Compression & Decompression. Call on huffTree.c to create the Huffman Tree from input file & output to compressed/decompressed file (.huff)
+ *
+ * Codes are canonical, so only their lengths are written: "HUF" & HUFF_MAXLEN, the 4 bit length of every symbol (128 bytes),
+ * the original file size, then the codes with the first bit highest. The decoder rebuilds the codes from the lengths
+ * and decodes with a lookup table instead of walking a tree
  */
 
 #include "huffTree.h"
 
-/* Function to write the Huffman tree to a file for decompression */
-void write_huff_tree(huffNode *node, FILE *output) {
-  if (node == NULL) {
+/* Find the code length of every symbol from its depth in the Huffman Tree
+ * N: Huffman Node, starts at root of tree
+ * depth: Depth of N
+ * depths: Output depth of each symbol, left alone for symbols not in the tree
+ */
+void huff_depths(huffNode *N, int depth, int *depths) {
+  if (N == NULL) {
     return;
   }
-  if (node->left == NULL && node->right == NULL) {
-    fprintf(output, "1%c", node->symbol); // Leaf node indicator
-  } else {
-    fprintf(output, "0"); // Internal node indicator
+  if (N->left == NULL && N->right == NULL) {
+    depths[N->symbol] = (depth > 0) ? depth : 1; // A lone symbol at the root still needs a 1 bit code
+    return;
   }
-  write_huff_tree(node->left, output);
-  write_huff_tree(node->right, output);
+  huff_depths(N->left, depth + 1, depths);
+  huff_depths(N->right, depth + 1, depths);
 }
 
-/* Read Huffman tree from file */
-huffNode *read_huff_tree(FILE *input) {
-  int c = fgetc(input);
-  if (c == '1') { // Leaf node
-    char symbol = fgetc(input);
-    return construct_node(symbol, 0);
-  } else if (c == '0') { // Internal node
-    huffNode *node = construct_node(-1, 0);
-    node->left = read_huff_tree(input);
-    node->right = read_huff_tree(input);
-    return node;
-  }
-  return NULL;
+/* Turn tree depths into code lengths no longer than HUFF_MAXLEN
+ * depths: Depth of each symbol in the Huffman Tree, 0 for symbols not in the file
+ * lengths: Output code length of each symbol
+ *
+ * Codes past HUFF_MAXLEN are cut to it, then codes are lengthened one at a time, the longest below HUFF_MAXLEN first,
+ * until the lengths fit in a code again. Symbols keep their order, so a more frequent symbol never gets a longer code
+ */
+void limit_lengths(int *depths, unsigned char *lengths) {
+  int count[HUFF_MAXLEN + 1] = {0}; // Number of codes of each length
+  int order[LENGTH];                // Symbols from shallowest to deepest
+  int symbols = 0, len;
+  long int total = 0;               // Sum of 2^(HUFF_MAXLEN - length), at most 2^HUFF_MAXLEN for a code to exist
+
+  for (int d = 1; d < LENGTH; d++) {
+    for (int s = 0; s < LENGTH; s++) {
+      if (depths[s] == d) {
+        order[symbols++] = s;
+        len = (d < HUFF_MAXLEN) ? d : HUFF_MAXLEN;
+        count[len]++;
+        total += 1L << (HUFF_MAXLEN - len);
+      }
+    }
+  }
+
+  // Take one code of HUFF_MAXLEN away & split a shorter one in two, each pass frees one slot
+  while (total > (1L << HUFF_MAXLEN)) {
+    count[HUFF_MAXLEN]--;
+    for (len = HUFF_MAXLEN - 1; len > 0; len--) {
+      if (count[len] > 0) {
+        count[len]--;
+        count[len + 1] += 2;
+        break;
+      }
+    }
+    total--;
+  }
+
+  // Hand the lengths back out, shortest to the shallowest symbols
+  memset(lengths, 0, LENGTH);
+  len = 1;
+  for (int k = 0; k < symbols; k++) {
+    while (count[len] == 0) {
+      len++;
+    }
+    lengths[order[k]] = len;
+    count[len]--;
+  }
+}
+
+/* Give each symbol its canonical code from the code lengths alone: shorter codes first, symbols of one length in order
+ * lengths: Code length of each symbol, 0 for symbols not in the file
+ * table: Output code of each symbol
+ *
+ * Returns 1, or 0 if the lengths need more codes than exist (corrupt file)
+ */
+int canonical_codes(unsigned char *lengths, dict *table) {
+  int count[HUFF_MAXLEN + 1] = {0};
+  unsigned int next[HUFF_MAXLEN + 1]; // Next code of each length
+  unsigned int code = 0;
+
+  for (int i = 0; i < LENGTH; i++) {
+    if (lengths[i] > HUFF_MAXLEN) {
+      return 0;
+    }
+    count[lengths[i]]++;
+  }
+  count[0] = 0;
+
+  for (int len = 1; len <= HUFF_MAXLEN; len++) {
+    code = (code + count[len - 1]) << 1;
+    next[len] = code;
+    if (code + count[len] > (1u << len)) {
+      return 0; // Over-subscribed
+    }
+  }
+
+  for (int i = 0; i < LENGTH; i++) {
+    table[i].symbol = i;
+    table[i].code_length = lengths[i];
+    table[i].code = (lengths[i] > 0) ? next[lengths[i]]++ : 0;
+  }
+  return 1;
+}
+
+/* Build the decoder's lookup table. Entry i of the primary table holds what the next HUFF_PRIMARY bits i decode to:
+ * one symbol, or two when a second code also ends inside those bits, or the secondary table of a longer code
+ * table: Canonical code of each symbol
+ * entries: Output number of entries, primary & secondary
+ *
+ * Returns the table, every unused entry has 0 bits
+ */
+huffEntry *build_decoder(dict *table, int *entries) {
+  huffEntry single[1 << HUFF_PRIMARY]; // Primary table with one symbol per entry
+  huffEntry *lookup, *e;
+  int secondary = 0, first, last, len;
+  unsigned int prefix;
+
+  // Give each prefix of codes longer than HUFF_PRIMARY its own secondary table
+  memset(single, 0, sizeof(single));
+  for (int i = 0; i < LENGTH; i++) {
+    len = table[i].code_length;
+    if (len > HUFF_PRIMARY) {
+      prefix = table[i].code >> (len - HUFF_PRIMARY);
+      if (single[prefix].count == 0 && single[prefix].bits == 0) {
+        single[prefix].bits = HUFF_PRIMARY;
+        single[prefix].next = (1 << HUFF_PRIMARY) + (secondary++ << HUFF_SECONDARY);
+      }
+    }
+  }
+  *entries = (1 << HUFF_PRIMARY) + (secondary << HUFF_SECONDARY);
+  lookup = (huffEntry *)calloc(*entries, sizeof(huffEntry));
+  if (lookup == NULL) {
+    return NULL;
+  }
+
+  // Fill every entry whose bits start with a code, the bits after it can be anything
+  for (int i = 0; i < LENGTH; i++) {
+    len = table[i].code_length;
+    if (len == 0) {
+      continue;
+    } else if (len <= HUFF_PRIMARY) {
+      first = table[i].code << (HUFF_PRIMARY - len);
+      last = (table[i].code + 1) << (HUFF_PRIMARY - len);
+      e = single;
+    } else {
+      prefix = table[i].code >> (len - HUFF_PRIMARY);
+      first = single[prefix].next + ((table[i].code << (HUFF_MAXLEN - len)) & ((1 << HUFF_SECONDARY) - 1));
+      last = first + (1 << (HUFF_MAXLEN - len));
+      e = lookup;
+    }
+    for (int j = first; j < last; j++) {
+      e[j].symbol[0] = i;
+      e[j].count = 1;
+      e[j].bits = len;
+      e[j].length = len;
+    }
+  }
+
+  // Pair each short code with the code after it when that one also ends inside the HUFF_PRIMARY bits
+  for (int i = 0; i < (1 << HUFF_PRIMARY); i++) {
+    lookup[i] = single[i];
+    if (single[i].count == 1 && single[i].bits < HUFF_PRIMARY) {
+      e = &single[(i << single[i].bits) & ((1 << HUFF_PRIMARY) - 1)]; // Bits left after the first code, padded with 0s
+      if (e->count == 1 && e->bits <= HUFF_PRIMARY - single[i].bits) {
+        lookup[i].symbol[1] = e->symbol[0];
+        lookup[i].count = 2;
+        lookup[i].bits += e->bits;
+      }
+    }
+  }
+  return lookup;
 }
 
 /* Compress a file using Huffman coding, optimized for executables */
 int huff_compress(FILE *input, char *title) {
   FILE *output;
   char *newTitle, *extension, *newExtension;
-  unsigned char *indata;
-  long int filesize;
+  unsigned char *indata, *outdata, lengths[LENGTH], header[4 + LENGTH / 2];
+  long int filesize, outsize;
   huffTree *huff;
-  queue *freq;
-  dict table[256];
+  int depths[LENGTH] = {0};
+  dict table[LENGTH];
 
   // Read file into buffer
   fseek(input, 0, SEEK_END);
   filesize = ftell(input);
   fseek(input, 0, SEEK_SET);
-  indata = (unsigned char *)malloc(filesize);
+  indata = (unsigned char *)malloc(filesize + 1);
   if (indata == NULL) {
     return 1;
   }
   fread(indata, 1, filesize, input);
   fclose(input);
 
-  // Create Huffman Tree
-  freq = init_freq(indata, filesize);
-  huff = create_huff_tree(indata, filesize);
-
-  // Generate Huffman codes
-  for (int i = 0; i < 256; i++) {
-    table[i].symbol = i;
-    table[i].code[0] = '\0'; // Initialize as empty
-  }
-
-  queueNode *N = freq->head;
-  while (N != NULL) {
-    huff_code(huff->root, N->node->symbol, table[N->node->symbol].code, 0);
-    table[N->node->symbol].code_length = strlen(table[N->node->symbol].code);
-    N = N->next;
+  // Create Huffman Tree & take only its code lengths, the codes themselves are canonical
+  if (filesize > 0) {
+    huff = create_huff_tree(indata, filesize);
+    huff_depths(huff->root, 0, depths);
+    huff_destruct(huff);
   }
+  limit_lengths(depths, lengths);
+  canonical_codes(lengths, table);
 
   // Handle new file name
   printf("Compressing %s...\n", title);
@@ -86,112 +223,179 @@ int huff_compress(FILE *input, char *title) {
   strcat(newTitle, newExtension); // Create a new file name to preserve the old file
 
   // Open output file in binary mode
-  char outname[256];
-  sprintf(outname, "%s", newTitle);
-  output = fopen(outname, "wb");
+  output = fopen(newTitle, "wb");
   if (output == NULL) {
+    free(newTitle);
+    free(indata);
     return 1;
   }
-  // Write tree to output as raw binary
-  write_huff_tree(huff->root, output);
+
+  // Write the header & code lengths, two to a byte
+  memcpy(header, "HUF", 3);
+  header[3] = HUFF_MAXLEN;
+  for (int i = 0; i < LENGTH / 2; i++) {
+    header[4 + i] = (lengths[2 * i] << 4) | lengths[2 * i + 1];
+  }
+  fwrite(header, 1, sizeof(header), output);
 
   // Write file size (for accurate decompression)
   fwrite(&filesize, sizeof(long int), 1, output);
 
-  // Write encoded data
-  unsigned char buffer = 0;
+  // Encode data into one buffer, codes go into a 64 bit buffer & whole bytes come out the top
+  outdata = (unsigned char *)malloc(filesize * 2 + 8); // Codes are at most 15 bits per byte
+  if (outdata == NULL) {
+    fclose(output);
+    free(newTitle);
+    free(indata);
+    return 1;
+  }
+  uint64_t buffer = 0;
   int bit_count = 0;
+  outsize = 0;
 
   for (long int i = 0; i < filesize; i++) {
-    char *code = table[indata[i]].code;
-    for (int j = 0; code[j] != '\0'; j++) {
-      buffer = (buffer << 1) | (code[j] - '0'); // Convert char '0' or '1' to bit
-      bit_count++;
-
-      if (bit_count == 8) {
-        fwrite(&buffer, 1, 1, output);
-        bit_count = 0;
-        buffer = 0;
-      }
+    buffer = (buffer << table[indata[i]].code_length) | table[indata[i]].code;
+    bit_count += table[indata[i]].code_length;
+    while (bit_count >= 8) {
+      bit_count -= 8;
+      outdata[outsize++] = (unsigned char)(buffer >> bit_count);
     }
   }
 
   // Handle leftover bits
   if (bit_count > 0) {
-    buffer <<= (8 - bit_count);
-    fwrite(&buffer, 1, 1, output);
+    outdata[outsize++] = (unsigned char)(buffer << (8 - bit_count));
   }
+  fwrite(outdata, 1, outsize, output);
 
   // Close the file, free the data, and leave
   fclose(output);
   free(newTitle);
+  free(outdata);
   free(indata);
-  queue_destruct(freq, 1);
-  huff_destruct(huff);
   return 0;
 }
 
 /* Decompress a Huffman encoded file, optimized for executables */
 int huff_decompress(FILE *input, char *title) {
+  unsigned char *indata, *outdata, lengths[LENGTH];
+  long int insize, filesize, pos, written;
+  int entries, len;
+  dict table[LENGTH];
+  huffEntry *lookup, *e;
 
-  // Handle new file name
-  char *newTitle, *extension, *newExtension;
+  // Read file into buffer
   printf("Decompressing %s...\n", title);
-  newExtension = ".u";
-  extension = strrchr(title, '.'); // Find location of file extension in title
-  if (extension != NULL) {
-    *extension = '\0'; // Get rid of old extension, if it exists
+  fseek(input, 0, SEEK_END);
+  insize = ftell(input);
+  fseek(input, 0, SEEK_SET);
+  indata = (unsigned char *)malloc(insize + 1);
+  if (indata == NULL) {
+    fclose(input);
+    return 1;
   }
-  newTitle = (char *)malloc(strlen(newExtension) + strlen(title) + 1); // Allocate enough space to store newTitle, char is 1 byte & include null terminator
-  strcpy(newTitle, title);
-  strcat(newTitle, newExtension); // Create a new file name to preserve the old file
+  fread(indata, 1, insize, input);
+  fclose(input);
 
-  // Open output file in binary mode
-  FILE *output;
-  char outname[256];
-  sprintf(outname, "%s", newTitle);
-  output = fopen(outname, "wb");
-  if (output == NULL) {
+  // Read header, code lengths & original file size
+  pos = 4 + LENGTH / 2 + sizeof(long int);
+  if (insize < pos || memcmp(indata, "HUF", 3) != 0 || indata[3] != HUFF_MAXLEN) {
+    printf("%s is not a Huffman file of this version\n", title);
+    free(indata);
+    return 1;
+  }
+  for (int i = 0; i < LENGTH / 2; i++) {
+    lengths[2 * i] = indata[4 + i] >> 4;
+    lengths[2 * i + 1] = indata[4 + i] & 0x0F;
+  }
+  memcpy(&filesize, indata + 4 + LENGTH / 2, sizeof(long int));
+  // Every code is at least 1 bit, so the data can't hold more bytes than it has bits
+  if (filesize < 0 || filesize > 8 * (insize - pos) || !canonical_codes(lengths, table)) {
+    printf("%s is corrupt\n", title);
+    free(indata);
+    return 1;
+  }
+  lookup = build_decoder(table, &entries);
+  outdata = (unsigned char *)malloc(filesize + 1);
+  if (lookup == NULL || outdata == NULL) {
+    printf("Out of memory for the %ld bytes of %s\n", filesize, title);
+    free(lookup);
+    free(outdata);
+    free(indata);
     return 1;
   }
 
-  // Read Huffman tree
-  huffNode *root = read_huff_tree(input);
+  // Decode data. The next bits sit at the top of a 64 bit buffer, refilled once fewer than a code are left
+  uint64_t buffer = 0, word;
+  int bit_count = 0;
+  written = 0;
 
-  // Read original file size
-  long int filesize;
-  fread(&filesize, sizeof(filesize), 1, input);
+  while (written < filesize) {
+    if (bit_count < HUFF_MAXLEN) {
+      if (pos + 8 <= insize) {
+        // Load 8 bytes, first byte highest, under the bits still held. Only whole bytes count, the rest are loaded again next time
+        word = 0;
+        for (int k = 0; k < 8; k++) {
+          word = (word << 8) | indata[pos + k];
+        }
+        buffer |= word >> bit_count;
+        pos += (63 - bit_count) >> 3;
+        bit_count |= 56;
+      } else {
+        while (bit_count <= 56 && pos < insize) {
+          buffer |= (uint64_t)indata[pos++] << (56 - bit_count);
+          bit_count += 8;
+        }
+      }
+    }
 
-  // Decode data
-  huffNode *node = root;
-  int c, total_bytes_written = 0;
+    // Look up the next HUFF_PRIMARY bits, & the HUFF_SECONDARY bits after them for a long code
+    e = &lookup[buffer >> (64 - HUFF_PRIMARY)];
+    if (e->count == 0 && e->bits > 0) {
+      e = &lookup[e->next + ((buffer << HUFF_PRIMARY) >> (64 - HUFF_SECONDARY))];
+    }
+    if (e->bits == 0 || e->length > bit_count) {
+      break; // No code starts with these bits, or the file ends inside one
+    }
 
-  while (total_bytes_written < filesize) {
-    c = fgetc(input);
-    if (c == EOF) {
-      break;
+    // Write the symbols, only the first when the file ends after it
+    outdata[written++] = e->symbol[0];
+    len = e->length;
+    if (e->count == 2 && written < filesize && e->bits <= bit_count) {
+      outdata[written++] = e->symbol[1];
+      len = e->bits;
     }
+    buffer <<= len;
+    bit_count -= len;
+  }
+  if (written < filesize) {
+    printf("%s is corrupt, decoded %ld of %ld bytes\n", title, written, filesize);
+  }
 
-    for (int i = 7; i >= 0; i--) {
-      int bit = (c >> i) & 1;
-      node = (bit == 0) ? node->left : node->right;
+  // Handle new file name
+  char *newTitle, *extension, *newExtension;
+  newExtension = ".u";
+  extension = strrchr(title, '.'); // Find location of file extension in title
+  if (extension != NULL) {
+    *extension = '\0'; // Get rid of old extension, if it exists
+  }
+  newTitle = (char *)malloc(strlen(newExtension) + strlen(title) + 1); // Allocate enough space to store newTitle, char is 1 byte & include null terminator
+  strcpy(newTitle, title);
+  strcat(newTitle, newExtension); // Create a new file name to preserve the old file
 
-      if (node->left == NULL && node->right == NULL) {
-        fputc(node->symbol, output);
-        node = root;
-        total_bytes_written++;
-        if (total_bytes_written >= filesize)
-          break; // Stop when original size is reached
-      }
-    }
+  // Open output file in binary mode & write everything decoded
+  FILE *output = fopen(newTitle, "wb");
+  if (output != NULL) {
+    fwrite(outdata, 1, written, output);
+    fclose(output);
   }
 
-  // Close the files and free the data
-  fclose(input);
-  fclose(output);
+  // Free the data
   free(newTitle);
-  huff_destruct_nodes(root);
-  return 0;
+  free(lookup);
+  free(outdata);
+  free(indata);
+  return (output == NULL || written < filesize) ? 1 : 0;
 }
 
 /* Handle user input & begin file compression/decompression with Huffman Algorithm */
@@ -213,9 +417,9 @@ int main(int argc, char *argv[]) {
 
   // Handle User Command, begin compression/decompression
   if (strcmp(argv[1], "-c") == 0) {
-    huff_compress(input, argv[2]);
+    return huff_compress(input, argv[2]);
   } else if (strcmp(argv[1], "-d") == 0) {
-    huff_decompress(input, argv[2]);
+    return huff_decompress(input, argv[2]);
   } else {
     printf("Invalid option. Use '-c' for compression, or '-d' for decompression.\n");
     return 1;
@@ -6,11 +6,15 @@
 
 #include <assert.h>
 #include <libgen.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define LENGTH 256 // Length of our alphabet (1 Byte)
+#define LENGTH 256                                  // Length of our alphabet (1 Byte)
+#define HUFF_MAXLEN 15                              // Longest code, so each length fits in 4 bits of the header
+#define HUFF_PRIMARY 11                             // Bits looked up at once by the decoder, codes up to this long need one lookup
+#define HUFF_SECONDARY (HUFF_MAXLEN - HUFF_PRIMARY) // Bits looked up in a secondary table, for codes longer than HUFF_PRIMARY
 
 /* DEFINE STRUCTURES */
 
@@ -44,10 +48,19 @@ typedef struct {
 // Create structure to hold symbols and their variable bits
 typedef struct {
   unsigned char symbol;
-  char code[32];   // Hold paths up to int length
-  int code_length; // Store length of code
+  unsigned int code; // Canonical code, the lowest code_length bits with the first bit highest
+  int code_length;   // Store length of code, 0 if the symbol is not in the file
 } dict;
 
+// Create structure to hold one entry of the decoder's lookup table. Primary entries are found from the next HUFF_PRIMARY bits
+typedef struct {
+  unsigned char symbol[2]; // Symbols the bits decode to, in order
+  unsigned char count;     // Number of symbols, 0 if the code is longer than HUFF_PRIMARY bits & ends in a secondary table
+  unsigned char bits;      // Bits taken by the symbols, 0 if no code starts with these bits
+  unsigned char length;    // Bits taken by the first symbol alone
+  unsigned short next;     // Index of the secondary table when count is 0, found from the HUFF_SECONDARY bits after
+} huffEntry;
+
 /* Function declarations */
 queue *queue_construct();                                           // Allocate memory for the Queue
 void queue_destruct(queue *Q, int option);                          // Deallocate memory for the Queue
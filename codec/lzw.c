@@ -6,168 +6,295 @@
  * Assumptions: User knows that code uses LZW method
  *
  * The program accepts one command line argument, including the name of the file
+ *
+ * -c writes codes of 9 to 16 bits, growing with the dictionary, after a 4 byte header ("LZW" & MAXBITS). Once the
+ * dictionary is full the ratio of the last CHECKGAP bytes is checked, and the dictionary is emptied with a CLEAR code
+ * once that window falls DROP below the best window since the last CLEAR, or once its codes cost STALE times more bits
+ * than spelling each byte of the window from its own alphabet. -c16 writes the old format: native 2 byte codes, no
+ * header, no CLEAR.
+ * -u tells the formats apart by the header, an old file can't start with it since its first code is below 256
  */
 
 #include <stdio.h> 
 #include <stdlib.h> 
 #include <string.h>
 #include <assert.h>
+#include <time.h>
 
 #define MAXCODE 65535 
-#define MAXPATTERN 100
-
-/* Structure to handle dictionary. Holding codes, patterns, and pattern length  
- * The alphabet is 1 byte [0, 255], will add more patterns later
+#define OLDPATTERN 100 //The old format never added patterns this long, so it still stops there to read & write the same codes
+#define HASHSIZE 131072 //Slots of the (prefix code, byte) hash table. Power of 2, twice MAXCODE, so probe runs stay short
+#define BUFSIZE 65536 //Bytes the output writer collects before handing them to the file
+#define MINBITS 9 //Width of the first codes & of every code after a CLEAR
+#define MAXBITS 16 //Widest code, reached once the dictionary holds 32768 codes
+#define CLEAR 256 //Code that empties the dictionary, so new codes start at 257. Variable width format only
+#define CHECKGAP 10000 //Bytes read between ratio checks once the dictionary is full
+#define DROP 0.05 //Fraction a window's ratio may fall below the best one before a CLEAR, windows of random data wobble ~1%
+#define STALE 1.5 //A window costing this many times its alphabet's bits per byte is matched by a dictionary of other data
+
+/* Structure to handle dictionary. The alphabet is 1 byte [0, 255], codes 0-255 are their own byte
+ * Every code past that is the pattern of its prefix code + one byte, so each takes 3 bytes & no pattern is stored whole.
+ * The compressor finds P+C from P's code & C through the hash table, the decompressor rebuilds a pattern by walking
+ * its prefixes back to a single byte
  */
 typedef struct {
-    unsigned char data[MAXCODE][MAXPATTERN]; //Create 2D array. Think of as simple table with rows & columns
-    int patternLength[MAXCODE]; //Store pattern length 
+    unsigned short int prefix[MAXCODE]; //Code of the pattern without its last byte
+    unsigned char suffix[MAXCODE]; //Last byte of the pattern
     unsigned short int numCode; //Number of current codes  
+    unsigned short int slot[HASHSIZE]; //Code stored in each slot of the hash table, 0 for an empty slot (no P+C code is below 256)
 } Dictionary; //For your sanity
 
+/* Structure to handle output. The file is opened once for the whole run, and bytes collect in the buffer
+ * until it is full or the writer is closed, so each write is a copy instead of an fopen/fwrite/fclose
+ */
+typedef struct {
+    FILE *fpt; //Output file
+    unsigned char buf[BUFSIZE]; //Bytes not written to the file yet
+    int used; //Number of bytes in buf
+    int failed; //1 once a write to the file failed
+    unsigned int bits; //Bits of write_bits() not yet making a whole byte, lowest bit first
+    int nbits; //Number of bits held in bits
+    long total; //Bytes handed to the file so far
+} Writer;
+
+//Structure to handle input codes, either packed variable width codes or old native 2 byte codes
+typedef struct {
+    unsigned char *data; //Whole compressed file, past the header
+    long size; //Bytes in data
+    long bit; //Position of the next code, in bits
+    int fixed; //1 for the old 2 byte format
+} Reader;
+
 //Function declarations 
 void init_dict(Dictionary *dict);
-unsigned short int find_code(Dictionary *dict, unsigned char A[MAXPATTERN]); 
+void reset_dict(Dictionary *dict, unsigned short int last); 
+int code_width(unsigned int last); 
+int alphabet_bits(unsigned char *data, long int length); 
+unsigned short int find_code(Dictionary *dict, unsigned short int prefix, unsigned char C); 
 int d_find_code(Dictionary *dict, unsigned short int code); 
-void add_dict(Dictionary *dict, unsigned char A[MAXPATTERN], int pLength); 
-void empty(unsigned char A[MAXPATTERN]); 
-void compress(FILE *fpt, char *filename, Dictionary *dict); 
+void add_dict(Dictionary *dict, unsigned short int prefix, unsigned char C); 
+void add_code(Dictionary *dict, unsigned short int prefix, unsigned char C); 
+int get_pattern(Dictionary *dict, unsigned short int code, unsigned char *scratch); 
+int open_writer(Writer *out, char *filename); 
+void write_bytes(Writer *out, unsigned char *data, int length); 
+void write_bits(Writer *out, unsigned int code, int width); 
+int close_writer(Writer *out); 
+int read_code(Reader *in, int width); 
+void compress(FILE *fpt, char *filename, Dictionary *dict, int fixed); 
 void decompress(FILE *fpt, char *filename, Dictionary *dict); 
 
-//Initialize the dictionary with 0-255 to represent one byte values 
+//Initialize the dictionary with 0-255 to represent one byte values, those need no entries
 void init_dict(Dictionary *dict) 
 { 
 	assert (dict != NULL); 
+	reset_dict(dict, 255);
+} 
 
-	//Set everything to empty in dictionary 
-	for (int i = 0; i < MAXCODE; i++) 
-	{ 
-		empty(dict->data[i]);
-		dict->patternLength[i] = 0;	
+//Forget every code past last, last is 255 for the old format & CLEAR for the variable width one
+void reset_dict(Dictionary *dict, unsigned short int last)
+{
+	memset(dict->slot, 0, sizeof(dict->slot)); //No P+C codes anymore, entries past last are overwritten as they come back
+	dict->numCode = last;
+}
+
+//Bits needed to write every code up to last, from MINBITS to MAXBITS
+int code_width(unsigned int last)
+{
+	int width = MINBITS;
+	while ((width < MAXBITS) && (last >= (1u << width))) width++;
+	return width;
+}
+
+//Bits per byte to give every distinct byte in data its own fixed width code
+int alphabet_bits(unsigned char *data, long int length)
+{
+	unsigned char seen[256] = {0};
+	int distinct = 0, bits = 0;
+
+	for (long int j = 0; j < length; j++)
+	{
+		if (!seen[data[j]]) distinct++;
+		seen[data[j]] = 1;
 	}
-	//Initalize 0-255 & keep track of size 
-	dict->numCode = 255;
-	for (int i = 0; i < 256; i++) 
-	{ 
-		dict->data[i][0] = i; //Code and Pattern. 1 byte for now at [0] 
-		dict->patternLength[i] = 1; //Pattern Length 
-	} 
-	
-	/*for (int i = 0; i < 256; i++) 
-	{ 
-		printf("%d Size is %d\n", dict->data[i][0], dict->patternLength[i]); 
-	}*/
-	
-} 
+	while ((1 << bits) < distinct) bits++;
+	return bits;
+}
 
-//Find if the code is in the dictionary, and return it back. Return 65535(not possible for index) if no code found
-unsigned short int find_code(Dictionary *dict, unsigned char A[MAXPATTERN]) 
-{ 
-	unsigned short int i = 0;
-        unsigned short int code;  	
-        int foundCode;
-	//printf("Number of codes is %u, find this pattern with length %d\n", (dict->numCode), patternLength);	
+//Find the hash table slot of P+C, either the slot holding its code or the empty slot where it would go
+static unsigned int find_slot(Dictionary *dict, unsigned short int prefix, unsigned char C)
+{
+	unsigned int key = ((unsigned int)prefix << 8) | C;
+	unsigned int slot = ((key + 1) * 2654435761u) >> 15; //Multiplicative hash, top 17 bits pick the slot
+	unsigned short int code;
 
-	//P+C in dict?
-        while ((i <= (dict->numCode)) && (foundCode != 0))
-        {
-		//Go through entire pattern and check if anything doesn't match
-                foundCode = memcmp(dict->data[i], A, MAXPATTERN); //Returns 0 if match
-		if (foundCode == 0) code = i;  		
-		i++; 
+	//Linear probing, the table is never more than half full so an empty slot always comes
+	while ((code = dict->slot[slot]) != 0)
+	{
+		if ((dict->prefix[code] == prefix) && (dict->suffix[code] == C)) break;
+		slot = (slot + 1) & (HASHSIZE - 1);
 	}
-	if (foundCode != 0) code = MAXCODE; //If not found, set code to max possible value
-	//printf("	We found code at %d\n", code);
-	return code; //Return if code was found or not  
+	return slot;
+}
+
+//Find the code of P+C, where P is given by its code. Return 65535(not possible for index) if no code found
+unsigned short int find_code(Dictionary *dict, unsigned short int prefix, unsigned char C) 
+{ 
+	unsigned short int code = dict->slot[find_slot(dict, prefix, C)];
+
+	if (code == 0) return MAXCODE; //If not found, return max possible value
+	return code; //Return the code that was found
 } 
 
-//Find if the code is in the dictionary, and return it back. Return an impossible code if none found
+//Find if the code is in the dictionary. Codes are handed out in order, so any code up to numCode is there
 int d_find_code(Dictionary *dict, unsigned short int code)
 {
-        unsigned short int i = 0;
-        int foundCode = 0;
-        //printf("Number of codes is %u\n", (dict->numCode));
-
-        //Code in dict?
-        while ((i <= (dict->numCode)) && (foundCode == 0))
-        {
-		//Code is in dictionary 
-		if (code == i) 
-		{
-		       foundCode = 1;	
-		}
-		i++;
-        }
-        	
-        return foundCode; //Return 0 for not found, 1 for found
+	return (code <= dict->numCode); //Return 0 for not found, 1 for found
 }
 
-//Add new code to the dictionary 
-void add_dict(Dictionary *dict, unsigned char A[MAXPATTERN], int pLength) 
+//Add P+C to the dictionary as the next code, unless it is full
+void add_dict(Dictionary *dict, unsigned short int prefix, unsigned char C) 
 { 
-	assert(pLength <= MAXPATTERN); //Hard to keep track of all lengths, double check that no impossible patterns are here
-	//printf("Adding new code with pattern length %d\n", pLength);
-	unsigned short int temp_numCode; 
 	if((dict->numCode) < (MAXCODE-2)) 
 	{
 		(dict->numCode)++; //Indicate that we're adding a new code 
-	        temp_numCode = (dict->numCode); //Store new code we're inserting to
-		(dict->patternLength[temp_numCode]) = pLength;
-		//printf("New pattern length is %d", dict->patternLength[temp_numCode]);
-
-		//Insert all bytes for pattern into the new code
-		memcpy(dict->data[temp_numCode], A, MAXPATTERN); 
+		dict->prefix[dict->numCode] = prefix;
+		dict->suffix[dict->numCode] = C;
 	}
 } 
 
-//Empty out 100 byte pattern
-void empty(unsigned char A[MAXPATTERN]) 
+//Add P+C to the dictionary for the compressor, which also has to find it again through the hash table
+void add_code(Dictionary *dict, unsigned short int prefix, unsigned char C) 
 { 
-	for (int i = 0; i < MAXPATTERN; i++) 
+	unsigned int slot;
+	if((dict->numCode) < (MAXCODE-2)) 
 	{
-	       A[i] = '\0';	
+		slot = find_slot(dict, prefix, C);
+		add_dict(dict, prefix, C);
+		dict->slot[slot] = dict->numCode;
 	}
-}  
+} 
 
-//Write to new file to output pattern. No more output buffer
-void output_code(char *filename, unsigned short int code)
+/* Rebuild the pattern of a code at the end of a scratch buffer, walking its prefixes back to a single byte
+ * scratch: Buffer of MAXCODE bytes, every pattern is shorter since each code adds one byte to an older one
+ * Return where the pattern starts in scratch, it ends at scratch + MAXCODE
+ */
+int get_pattern(Dictionary *dict, unsigned short int code, unsigned char *scratch)
 {
-        assert(code < MAXCODE); //Make sure possible code
-	FILE *fpt; 
-	//printf("Outputting code %d\n", code);
+	int start = MAXCODE;
+	while (code > 255)
+	{
+		scratch[--start] = dict->suffix[code];
+		code = dict->prefix[code];
+	}
+	scratch[--start] = (unsigned char)code;
+	return start;
+}
 
-        //Write to a new compressed/decompressed file
-        fpt = fopen(filename, "ab");
-        fwrite(&code, sizeof(code), 1, fpt); //Write binary data to the file
-        fclose(fpt);
+
+//Open the output file for the whole run, replacing any old one. Return 1 on success, 0 if it couldn't be created
+int open_writer(Writer *out, char *filename)
+{
+	out->used = 0;
+	out->failed = 0;
+	out->bits = 0;
+	out->nbits = 0;
+	out->total = 0;
+	out->fpt = fopen(filename, "wb");
+	return (out->fpt != NULL);
 }
 
-//Write to new file to output pattern. No more output buffer
-void output_pattern(char *filename, unsigned char P[MAXPATTERN], int patternLength) 
+//Hand the buffered bytes to the file & empty the buffer
+static void flush_writer(Writer *out)
 {
-	assert(patternLength <= MAXPATTERN); //Make sure possible pattern
-	FILE *fpt; 
+	if ((out->used > 0) && (fwrite(out->buf, 1, out->used, out->fpt) != (size_t)out->used)) out->failed = 1;
+	out->total += out->used;
+	out->used = 0;
+}
 
-	/*for (int i = 0; i < patternLength; i++) 
-	{ 
-		printf("Outputting pattern %d\n", P[i]); 
-	}*/
+//Add bytes to the output, the buffer goes to the file whenever it fills up
+void write_bytes(Writer *out, unsigned char *data, int length)
+{
+	int n;
+	while (length > 0)
+	{
+		if (out->used == BUFSIZE) flush_writer(out);
+		n = (length < BUFSIZE - out->used) ? length : BUFSIZE - out->used; //Room left in the buffer
+		memcpy(out->buf + out->used, data, n);
+		out->used += n;
+		data += n;
+		length -= n;
+	}
+}
 
-	//Write to a new compressed/decompressed file
-        fpt = fopen(filename, "ab");
-        fwrite(P, 1, patternLength, fpt); //Write binary data to the file
-        fclose(fpt); 
+//Add a code of width bits to the output, lowest bit first. Whole bytes go to the buffer, the rest waits for the next code
+void write_bits(Writer *out, unsigned int code, int width)
+{
+	out->bits |= code << out->nbits;
+	out->nbits += width;
+	while (out->nbits >= 8)
+	{
+		if (out->used == BUFSIZE) flush_writer(out);
+		out->buf[out->used++] = (unsigned char)(out->bits & 0xFF);
+		out->bits >>= 8;
+		out->nbits -= 8;
+	}
+}
+
+//Write what is left in the buffer & close the file. Return 1 if every byte made it to the file, 0 otherwise
+int close_writer(Writer *out)
+{
+	//Pad the last bits of write_bits() with 0s to a whole byte. Fewer than MINBITS, so never read as a code
+	if (out->nbits > 0) write_bits(out, 0, 8 - out->nbits);
+	flush_writer(out);
+	if (fclose(out->fpt) != 0) out->failed = 1;
+	out->fpt = NULL;
+	return !(out->failed);
 }
 
-//Compress the patterns from the uncompress filed. Take in 1 byte patterns, shoot out 2 byte codes 
-void compress(FILE *fpt, char *filename, Dictionary *dict) 
+//Output one 2 byte code
+void output_code(Writer *out, unsigned short int code)
+{
+        assert(code < MAXCODE); //Make sure possible code
+        write_bytes(out, (unsigned char *)&code, sizeof(code)); //Same bytes fwrite(&code) used to write
+}
+
+//Read the next code, width bits wide (always 16 for the old format). Return -1 once no whole code is left
+int read_code(Reader *in, int width)
+{
+	unsigned short int code;
+	unsigned int bits = 0;
+	long byte = in->bit >> 3;
+
+	//Old format, one native 2 byte code
+	if (in->fixed)
+	{
+		if (byte + 2 > in->size) return -1;
+		memcpy(&code, in->data + byte, sizeof(code));
+		in->bit += 16;
+		return code;
+	}
+
+	//Codes are at most 16 bits starting at most 7 bits into a byte, so 3 bytes always hold one
+	if (in->bit + width > in->size * 8) return -1;
+	for (int n = 0; (n < 3) && (byte + n < in->size); n++) bits |= (unsigned int)in->data[byte + n] << (8 * n);
+	in->bit += width;
+	return (bits >> ((in->bit - width) & 7)) & ((1u << width) - 1);
+}
+
+/* Compress the patterns from the uncompress filed. Take in 1 byte patterns, shoot out 9 to 16 bit codes
+ * fixed: 1 for the old format of 2 byte codes
+ */
+void compress(FILE *fpt, char *filename, Dictionary *dict, int fixed) 
 { 
         //Declarations to handle compression & accessing file
-	int P_Length, PC_Length;
-        long int i, filesize;
-        unsigned short int code;
-        unsigned char *indata, P[MAXPATTERN], PC[MAXPATTERN], C;
+	int P_Length, width, limit;
+        long int i, filesize, check, mark;
+        unsigned short int code, P;
+        unsigned char *indata, C, header[4] = {'L', 'Z', 'W', MAXBITS};
         char *newfilename, *extension, *newExtension; 
+        Writer *out;
+        double ratio, best, outbits, markbits;
+        clock_t start;
 
 	fseek(fpt, 0, SEEK_END); //Go to the end of the file, no offset!
         filesize = ftell(fpt); //Set size of file by our current position in the file
@@ -185,88 +312,158 @@ void compress(FILE *fpt, char *filename, Dictionary *dict)
          strcpy(newfilename, filename);
          strcat(newfilename, newExtension); //Create a new file name to preserve the old file
 
-         //Start LZW Compression
-         empty(P); //Let P(preview) = empty
-         P_Length = 0; //Keep track of our preview's length.
+         //Open the new file once for every code
+         out = (Writer *)malloc(sizeof(Writer));
+         if (!open_writer(out, newfilename))
+         {
+                 printf("Could not create %s\n", newfilename);
+                 free(out);
+                 free(newfilename);
+                 free(indata);
+                 return;
+         }
+
+         //Start LZW Compression. P(preview) is held by its code, so P+C is found from P's code & C
+         start = clock();
+         P = 0;
+         P_Length = 0; //Keep track of our preview's length, 0 while P is empty
+         limit = fixed ? OLDPATTERN : MAXCODE; //Patterns stay shorter than this. MAXCODE is out of reach, each code is 1 byte longer than an older one
+         check = 0; //Input position of the next ratio check
+         best = 0; //Best window ratio since the dictionary was last emptied
+         outbits = 0; //Bits of codes written so far
+         mark = 0; //Input position at the last check or CLEAR, where the window starts
+         markbits = 0; //outbits at mark
+         if (!fixed)
+         {
+                 write_bytes(out, header, sizeof(header));
+                 reset_dict(dict, CLEAR); //Keep CLEAR out of the codes handed to patterns
+         }
 
          //Go through entire file and compress
          for (i = 0; i < filesize; i++)
          {
-		 empty(PC); //Make sure P+C is empty before each use
-                 PC_Length = 0;
                  C = indata[i]; //Read C(current)
-                 //printf("C = %d\n", C);
 
-                 //P+C. Don't go over max length. Our Pattern (100)
-                 if (P_Length < MAXPATTERN)
+                 //P empty, P+C is the single byte C, always in the dictionary
+                 if (P_Length == 0)
                  {
-			 memcpy(PC, P, MAXPATTERN); //Add P first
-                         PC_Length = P_Length; //Now we know length of P
-                         PC[PC_Length] = C; //Add in C
-                         //printf("C is %d\n", PC[PC_Length]);
-                         PC_Length++; //Assign new length (Account for C's length)
-		 }
+                         P = C;
+                         P_Length = 1;
+                         continue;
+                 }
+
+                 //P+C in dict? Patterns never grow past our max length
+                 code = (P_Length + 1 < limit) ? find_code(dict, P, C) : MAXCODE;
 
-                 //P+C in dict?
-                 //printf("Grab code for P+C\n");
-                 code = find_code(dict, PC);
-                 //printf("Code is %d\n", code);
-		 
 		 //No, not in dictionary
                  if (code == MAXCODE)
                  {
-			 //printf("Could not find code\n");
-                         //printf("Grab code for P\n");
-                         code = find_code(dict, P); //Grab code for P
-                         output_code(newfilename, code);//Output code for P
-                         if (PC_Length < MAXPATTERN) add_dict(dict, PC, PC_Length); //Add P+C to dictionary
-                         empty(P); //Empty out old pattern
-                         P[0] = C; //P = C
+                         //Output code for P, wide enough for every code in the dictionary
+                         if (fixed) output_code(out, P);
+                         else
+                         {
+                                 width = code_width(dict->numCode);
+                                 write_bits(out, P, width);
+                                 outbits += width;
+                         }
+
+                         //Dictionary full & the last window well below the best one, or matched by patterns of other data?
+                         //Start over with an empty one. Full means width is MAXBITS, so the decompressor reads CLEAR at
+                         //the width it expects. The first window after a CLEAR spans the refill & sets best again
+                         if (!fixed && (dict->numCode >= MAXCODE - 2) && (i >= check))
+                         {
+                                 check = i + CHECKGAP;
+                                 ratio = ((i - mark) * 8.0) / (outbits - markbits); //Input bits per output bit since the last check
+                                 if (ratio > best) best = ratio;
+                                 if ((ratio >= best * (1 - DROP)) && (8.0 / ratio <= STALE * alphabet_bits(indata + i - CHECKGAP, CHECKGAP)))
+                                 {
+                                         mark = i;
+                                         markbits = outbits;
+                                 }
+                                 else
+                                 {
+                                         write_bits(out, CLEAR, width);
+                                         outbits += width;
+                                         reset_dict(dict, CLEAR);
+                                         best = 0;
+                                         mark = i;
+                                         markbits = outbits;
+                                         P = C;
+                                         P_Length = 1;
+                                         continue;
+                                 }
+                         }
+                         if (P_Length + 1 < limit) add_code(dict, P, C); //Add P+C to dictionary
+                         P = C; //P = C
                          P_Length = 1; //Set new length for P
 		 } 
 		 
 		 //Yes, in dictionary
                  else
                  {
-			 memcpy(P, PC, MAXPATTERN); //Let P = P+C
-                         P_Length = PC_Length;
-		 }
-		 
-		 //More data?
-                 if(i == (filesize - 1))
-		 {
-			 //printf("Filesize is %ld, i is %d\n", filesize, i);
-			 //printf("End of file\n");
-			 code = find_code(dict, P); //Grab code for P
-			 output_code(newfilename, code);//No more data, output code for P
+			 P = code; //Let P = P+C
+                         P_Length++;
 		 }
 	 } 
 
-	 //Let user know what their new file saved to
-         printf("New file saved to %s\n", newfilename); 
+	 //No more data, output code for P
+	 if ((P_Length > 0) && fixed) output_code(out, P);
+	 else if (P_Length > 0) write_bits(out, P, code_width(dict->numCode));
+
+	 //Let user know what their new file saved to, & how well & fast it was compressed
+         if (close_writer(out))
+         {
+                 printf("New file saved to %s\n", newfilename); 
+                 printf("%ld bytes to %ld bytes (%.3f:1) in %.3f s\n", filesize, out->total,
+                         (out->total > 0) ? (double)filesize / out->total : 0.0, (double)(clock() - start) / CLOCKS_PER_SEC);
+         }
+         else printf("Could not write %s\n", newfilename);
 
 	 //Free the data & leave
+	 free(out);
 	 free(newfilename); 
 	 free(indata);
 } 
 
-//Decompress the codes from the compressed file. Take in 2 byte code, shoot out 1 byte pattern
+//Decompress the codes from the compressed file. Take in 9 to 16 bit codes (or old 2 byte codes), shoot out 1 byte pattern
 void decompress(FILE *fpt, char *filename, Dictionary *dict) 
 { 
 	//Declarations to handle decompression & accessing file
-        int C_Length, P_Length, XZ_Length;
-        long int i, filesize;
-        unsigned short int *indata, P, C;
-        unsigned char c_pattern[MAXPATTERN], p_pattern[MAXPATTERN], X[MAXPATTERN], XZ[MAXPATTERN], Z;
+        int P_Length, C_Length, start, first, next, width, limit, broken;
+        long int filesize;
+        unsigned short int P, C;
+        unsigned char *indata, *scratch, Z;
         char *newfilename, *extension, *newExtension;
+        Writer *out;
+        Reader in;
 
 	fseek(fpt, 0, SEEK_END); //Go to the end of the file, no offset!
         filesize = ftell(fpt); //Set size of file by our current position in the file
-        indata = (unsigned short int *)malloc(filesize);	
+        indata = (unsigned char *)malloc(filesize + 1);	
         fseek(fpt, 0, SEEK_SET); //Go back to the beginning of the file to read the data
-        fread(indata, 2, (filesize/2), fpt); //Store our 2 byte codes into input buffer
+        fread(indata, 1, filesize, fpt); //Store our codes into input buffer
         fclose(fpt); 
 
+        //Tell the formats apart, the old one has no header
+        in.data = indata;
+        in.size = filesize;
+        in.bit = 0;
+        in.fixed = 1;
+        if ((filesize >= 4) && (memcmp(indata, "LZW", 3) == 0))
+        {
+                if (indata[3] != MAXBITS)
+                {
+                        printf("%s uses codes of up to %d bits, only %d are supported\n", filename, indata[3], MAXBITS);
+                        free(indata);
+                        return;
+                }
+                in.data = indata + 4;
+                in.size = filesize - 4;
+                in.fixed = 0;
+                reset_dict(dict, CLEAR); //Keep CLEAR out of the codes handed to patterns
+        }
+        limit = in.fixed ? OLDPATTERN : MAXCODE; //Patterns stay shorter than this, same as the compressor
+
 	//Handle new file name
 	printf("Decompressing %s...\n", filename);
         newExtension = ".u";
@@ -275,90 +472,106 @@ void decompress(FILE *fpt, char *filename, Dictionary *dict)
         newfilename = (char *)malloc(strlen(newExtension) + strlen(filename) + 1); //Allocate enough space to store newfilename, char is 1 byte & include null terminator
         strcpy(newfilename, filename);
         strcat(newfilename, newExtension); //Create a new file name to preserve the old file 
-        //printf("Amount of codes %ld\n", (filesize/2));
+
+        //Open the new file once for every pattern, & the buffer every pattern is rebuilt in
+        out = (Writer *)malloc(sizeof(Writer));
+        if (!open_writer(out, newfilename))
+        {
+                printf("Could not create %s\n", newfilename);
+                free(out);
+                free(newfilename);
+                free(indata);
+                return;
+        }
+        scratch = (unsigned char *)malloc(MAXCODE);
 
 	//Begin Decompression 
-	/*for(i = 0; i<(filesize/2);i++) 
-	{
-	       printf("Inside compressed file %d\n", indata[i]);	
-	}*/	
 	C = 0; 
 	P = 0;
-	C_Length = 0;
         P_Length = 0;
-        XZ_Length = 0;
+        first = 1; //1 while the next code is the first one since the start or a CLEAR
+        broken = 0; //1 once a code the dictionary can't explain stops the decoding
 
-	//Read C(current)
-        C = indata[0]; 
-        //printf("Initial C code is %d\n", C);	
-	if(d_find_code(dict,C)) 
-	{
-		memcpy(c_pattern, dict->data[C], MAXPATTERN); 
-		C_Length = dict->patternLength[C];	
-	}
-        output_pattern(newfilename, c_pattern, C_Length); //Output pattern for C
-	
-	//Go through each pair in compressed file
-        for (i = 1; i < (filesize/2); i++)
+	//Go through each code in compressed file
+        while (1)
         {
-		//printf("Going through %ld, is is %ld\n", filesize, i);
-		//Empty out all temporary patterns
-		empty(c_pattern); 
-		empty(p_pattern);
-		empty(X); 
-		empty(XZ);	
-
-		//Let P(preview) = C
-	        P = C; 
-		//printf("P code is %d\n", P); 
-		if(d_find_code(dict, P)) 
-		{ 
-			memcpy(p_pattern, dict->data[P], MAXPATTERN); //Copy over pattern from given code 
-			P_Length = dict->patternLength[P];		
+		//Width the compressor wrote the next code with. It added P+C right after writing P, but P+C is only added
+		//here once C is read, so count that code as if it were there already
+		if (first) width = code_width(dict->numCode);
+		else
+		{
+			next = dict->numCode;
+			if ((P_Length + 1 < limit) && (next < MAXCODE - 2)) next++;
+			width = code_width(next);
 		}
+		next = read_code(&in, width);
+		if (next < 0) break; //End of file...DONE
 
-		C = indata[i]; //Read C(current)  
-		//printf("C code is %d\n", C); 
-		//Is C in dictionary?
-		if(d_find_code(dict, C)) 
+		//Empty the dictionary, the next code starts over
+		if (!in.fixed && (next == CLEAR))
+		{
+			reset_dict(dict, CLEAR);
+			first = 1;
+			continue;
+		}
+
+		//Let P(preview) = C, read C(current)
+		P = C;
+		C = next;
+
+		//First code, output its byte. It has no P to add a code with
+		if (first)
+		{
+			if (C > 255) //Can't start with a code that isn't there yet, broken file
+			{
+				broken = 1;
+				break;
+			}
+			Z = C;
+			write_bytes(out, &Z, 1); //Output pattern for C
+			P_Length = 1;
+			first = 0;
+			continue;
+		}
+
+		//Is C in dictionary? Output pattern for C, Z = 1st char of pattern for C
+		if (d_find_code(dict, C)) 
 		{  
-			memcpy(c_pattern, dict->data[C], MAXPATTERN); //Copy over pattern from given code 
-			C_Length = dict->patternLength[C]; //Grab pattern length
+			start = get_pattern(dict, C, scratch);
+			Z = scratch[start];
+			C_Length = MAXCODE - start;
+			write_bytes(out, scratch + start, C_Length);
 		}
-		
-		//Not in dictionary
-                if ((d_find_code(dict,C)) == 0)
+
+		//Not in dictionary, only the code about to be added can be missing. Output X+Z, where X is pattern for P & Z its 1st char
+		else if ((C == dict->numCode + 1) && (P_Length + 1 < limit))
 		{
-			memcpy(X, p_pattern, MAXPATTERN); //Let X = pattern for P
-			Z = p_pattern[0]; //Let Z = 1st char of pattern for P
-			memcpy(XZ, X, MAXPATTERN);
-			XZ_Length = P_Length;
-			XZ[XZ_Length] = Z; //Get X+Z
-			XZ_Length++; //Account for new length with additional Z
-			output_pattern(newfilename, XZ, XZ_Length); //Output X+Z
-			if (XZ_Length < MAXPATTERN) add_dict(dict, XZ, XZ_Length); //Add X+Z to dictionary
+			start = get_pattern(dict, P, scratch);
+			Z = scratch[start];
+			write_bytes(out, scratch + start, P_Length);
+			write_bytes(out, &Z, 1);
+			C_Length = P_Length + 1;
 		}
-		
-		//Yes, in dictionary
-		else
+		else //Broken file
 		{
-			output_pattern(newfilename, c_pattern, C_Length); //Output pattern for C 
-			memcpy(X, p_pattern, MAXPATTERN); //Let X = pattern for P
-			Z = c_pattern[0]; //Let Z = 1st char of pattern for C
-			memcpy(XZ, X, MAXPATTERN);
-			XZ_Length = P_Length;
-			XZ[XZ_Length] = Z; //Get X+Z
-			XZ_Length++; //Account for new length with additional Z
-			if (XZ_Length < MAXPATTERN) add_dict(dict, XZ, XZ_Length); //Add X+Z to dictionary
+			broken = 1;
+			break;
 		}
-		
-		//End of file...DONE
+
+		//Add X+Z to dictionary, C is the next P
+		if (P_Length + 1 < limit) add_dict(dict, P, Z);
+		P_Length = C_Length;
 	}
 
-	//Let user know what their new file saved to
-        printf("New file saved to %s\n", newfilename);
+	//Let user know what their new file saved to, or that only the part before the break was
+        if (extension != NULL) *extension = '.'; //Give the input its extension back for the messages
+        if (!close_writer(out)) printf("Could not write %s\n", newfilename);
+        else if (broken) printf("%s is corrupt, decoded %ld bytes to %s\n", filename, out->total, newfilename);
+        else printf("New file saved to %s\n", newfilename);
 
 	//Free the data & leave
+        free(scratch);
+        free(out);
         free(newfilename);
         free(indata);
 }
@@ -376,6 +589,7 @@ int main(int argc, char *argv[])
 	{
 		printf("Program use is ./lzw command 'filename'\n"); 
 		printf("Use command -c for compression\n"); 
+		printf("Use command -c16 for compression to the old format of 2 byte codes\n"); 
 		printf("Use command -u for decompression\n");
 		exit(0);	
 	} 
@@ -399,7 +613,13 @@ int main(int argc, char *argv[])
 	//Compress the file
 	if (strcmp("-c", command) == 0) 
 	{  
-	        compress(fpt, filename, dict); //Let function handle compression due to differences in input data from decompression
+	        compress(fpt, filename, dict, 0); //Let function handle compression due to differences in input data from decompression
+	} 
+
+	//Compress the file to the old format
+	else if (strcmp("-c16", command) == 0) 
+	{  
+	        compress(fpt, filename, dict, 1);
 	} 
 	
 	//Decompress the file
@@ -413,6 +633,7 @@ int main(int argc, char *argv[])
 	{ 
 		printf("Invalid command, exiting program\n");
 		printf("Use command -c for compression\n");
+		printf("Use command -c16 for compression to the old format of 2 byte codes\n"); 
                 printf("Use command -u for decompression\n"); 
 		return 0;
 	} 
@@ -0,0 +1,58 @@
+/* array.h
+ * Array Library
+ *
+ * Purpose: To hold the big tables of the renderer (BVH nodes, triangle table) either in memory of their own,
+ *          like std::vector, or in memory owned by someone else, such as a mapped .rscene file. Loaded scenes are
+ *          then rendered in place, without copying a byte
+ *
+ * Assumptions: Borrowed memory is read only & outlives the array. Only arrays that own their memory are changed
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+/* Declare Classes */
+
+//Class holds a run of T, owned or borrowed
+template <class T>
+class Array {
+public:
+	/* Constructors */
+	Array() : ptr(NULL), len(0) {}
+	Array(const Array&) = delete; //Borrowed memory can't be copied safely, no copies
+	Array& operator=(const Array&) = delete;
+
+	/* Member Functions, same meaning as std::vector. Every change first makes the array own its memory */
+	void assign(size_t n, const T& value) { own.assign(n, value); sync(); }
+	void resize(size_t n) { own.resize(n); sync(); }
+	void reserve(size_t n) { own.reserve(n); sync(); }
+	void push_back(const T& value) { own.push_back(value); sync(); }
+	void clear() { own.clear(); sync(); }
+	void release() { std::vector<T>().swap(own); sync(); } //Empty the array & give its memory back, borrowed or not
+
+	/* Point at memory owned by someone else, dropping any memory of our own
+	 * data: First element, must stay valid while the array uses it
+	 * n: Number of elements
+	 */
+	void borrow(const T* data, size_t n)
+	{
+		std::vector<T>().swap(own);
+		ptr = const_cast<T*>(data); //Never written through, see Assumptions
+		len = n;
+	}
+
+	T& operator[](size_t i) { return ptr[i]; }
+	const T& operator[](size_t i) const { return ptr[i]; }
+	const T* data() const { return ptr; }
+	size_t size() const { return len; }
+	bool empty() const { return len == 0; }
+
+private:
+	std::vector<T> own; //Memory of our own, empty while borrowing
+	T* ptr; //First element, in own or in borrowed memory
+	size_t len; //Number of elements
+
+	void sync() { ptr = own.data(); len = own.size(); }
+};
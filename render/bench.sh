@@ -0,0 +1,45 @@
+#!/bin/bash
+
+# bench.sh
+# Benchmark for render2
+
+# Script to render the bundled models from the same fixed views with --stats,
+# so every engine change in render/ comes with comparable numbers
+#
+# Usage: ./bench.sh [model directory] [extra render2 options]
+#   ./bench.sh                         -- models in the current directory
+#   ./bench.sh ~/models --engine raster --threads 4
+
+dir=${1:-.}
+shift
+
+# set these lists with the parameter space's values
+models='cow airplane footbones big_porsche big_dodge dragon_vrip_res4'
+
+# camera rotations, X Y Z degrees
+views='0 0 0
+0 90 0
+45 30 60'
+
+size='--width 512 --height 512'
+
+# images go to a scratch directory, so the .ppm files next to the models are not overwritten
+render=$(realpath ./render2)
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+
+for m in $models
+do
+    if [ ! -f "$dir/$m.ply" ]
+    then
+        echo "Skipping $m, $dir/$m.ply not found"
+        continue
+    fi
+    ln -s "$(realpath "$dir/$m.ply")" "$out/$m.ply"
+
+    echo "$views" | while read x y z
+    do
+        echo "Model: $m  View: $x $y $z"
+        (cd "$out" && "$render" $m.ply $x $y $z $size --stats "$@") | grep -v "Outputting"
+    done
+done
@@ -0,0 +1,490 @@
+/* bvh.cpp
+ * Bounding Volume Hierarchy
+ *
+ * Purpose: To build a hierarchy of boxes over the triangles of the .ply file, and find the closest triangle along a pixel ray
+ *          without testing every face. Splits are chosen with a binned Surface Area Heuristic (SAH)
+ *
+ * Assumptions: Closest hit must match the brute force loop, so ties on distance go to the lowest triangle index
+ */
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "render2.h"
+#include "tri_table.h"
+#include "bvh.h"
+
+#define BVH_MAX_DEPTH 64 //Deepest node allowed, also sizes the traversal stack
+#define BVH_PAD 1e-5f //Boxes are padded by this fraction of the scene size so rounding never misses a hit
+
+/* Grow a box so it holds the given point
+ * min: Box minimum corner, updated in place
+ * max: Box maximum corner, updated in place
+ * p: Point that must fit inside the box
+ */
+static void grow(Vector& min, Vector& max, const Vector& p)
+{
+	if (p.a < min.a) min.a = p.a;
+	if (p.b < min.b) min.b = p.b;
+	if (p.c < min.c) min.c = p.c;
+	if (p.a > max.a) max.a = p.a;
+	if (p.b > max.b) max.b = p.b;
+	if (p.c > max.c) max.c = p.c;
+}
+
+/* Find half the surface area of a box, enough for comparing SAH costs
+ * min: Box minimum corner
+ * max: Box maximum corner
+ */
+static float half_area(const Vector& min, const Vector& max)
+{
+	Vector e = max - min;
+	if (e.a < 0 || e.b < 0 || e.c < 0) return 0; //Empty box
+	return (e.a * e.b) + (e.b * e.c) + (e.c * e.a);
+}
+
+/* Grab one axis of a vector, 0 = a(x), 1 = b(y), 2 = c(z)
+ * v: Vector to read from
+ * axis: Which component to return
+ */
+static float axis_of(const Vector& v, int axis)
+{
+	return (axis == 0) ? v.a : ((axis == 1) ? v.b : v.c);
+}
+
+/* Build the hierarchy over every triangle of the mesh
+ * V: Table that stores all vertices from .ply file
+ * triangle: Table that stores all faces from .ply file
+ */
+void BVH::build(const std::vector<Vector>& V, const std::vector<Face>& triangle)
+{
+	int faces = (int)triangle.size();
+	nodes.clear();
+	index.resize(faces);
+	if (faces == 0) return; //Nothing to build, closest_hit will find nothing
+
+	//Find box & centroid of every triangle once
+	std::vector<Vector> tri_min(faces), tri_max(faces), centroid(faces);
+	for (int i = 0; i < faces; i++)
+	{
+		Vector v0 = V[triangle[i].v0], v1 = V[triangle[i].v1], v2 = V[triangle[i].v2];
+		tri_min[i] = v0;
+		tri_max[i] = v0;
+		grow(tri_min[i], tri_max[i], v1);
+		grow(tri_min[i], tri_max[i], v2);
+		centroid[i] = (tri_min[i] + tri_max[i]) * 0.5f;
+		index[i] = i;
+	}
+
+	//Worst case a binary tree has 2n-1 nodes
+	nodes.reserve(2 * faces);
+	nodes.push_back(BVHNode());
+	nodes[0].first = 0;
+	nodes[0].count = faces;
+
+	//Split nodes until every leaf is small enough. Stack holds (node, depth)
+	std::vector<std::pair<int, int>> todo;
+	todo.push_back(std::make_pair(0, 0));
+	float pad = -1;
+	while (!todo.empty())
+	{
+		int n = todo.back().first;
+		int depth = todo.back().second;
+		todo.pop_back();
+
+		int first = nodes[n].first, count = nodes[n].count;
+
+		//Find box of the triangles & box of their centroids
+		Vector bmin(FLOAT_MAX, FLOAT_MAX, FLOAT_MAX), bmax(-FLOAT_MAX, -FLOAT_MAX, -FLOAT_MAX);
+		Vector cmin = bmin, cmax = bmax;
+		for (int i = first; i < first + count; i++)
+		{
+			grow(bmin, bmax, tri_min[index[i]]);
+			grow(bmin, bmax, tri_max[index[i]]);
+			grow(cmin, cmax, centroid[index[i]]);
+		}
+
+		//Padding is taken from the root box, so every box grows by the same amount
+		if (pad < 0) pad = BVH_PAD * find_e(bmax, bmin) + 1e-30f;
+		nodes[n].min = bmin - Vector(pad, pad, pad);
+		nodes[n].max = bmax + Vector(pad, pad, pad);
+
+		if (count <= BVH_LEAF_SIZE || depth >= BVH_MAX_DEPTH - 1) continue; //Small enough, stays a leaf
+
+		//Try every bin boundary on every axis, keep the cheapest split
+		float best_cost = FLOAT_MAX;
+		int best_axis = -1, best_split = 0;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float lo = axis_of(cmin, axis), hi = axis_of(cmax, axis);
+			if (hi <= lo) continue; //All centroids on one plane, can't split this axis
+
+			int bin_count[BVH_BINS] = { 0 };
+			Vector bin_min[BVH_BINS], bin_max[BVH_BINS];
+			for (int b = 0; b < BVH_BINS; b++)
+			{
+				bin_min[b] = Vector(FLOAT_MAX, FLOAT_MAX, FLOAT_MAX);
+				bin_max[b] = Vector(-FLOAT_MAX, -FLOAT_MAX, -FLOAT_MAX);
+			}
+
+			//Drop each triangle into the bin that holds its centroid
+			float scale = BVH_BINS / (hi - lo);
+			for (int i = first; i < first + count; i++)
+			{
+				int b = (int)((axis_of(centroid[index[i]], axis) - lo) * scale);
+				if (b >= BVH_BINS) b = BVH_BINS - 1;
+				bin_count[b]++;
+				grow(bin_min[b], bin_max[b], tri_min[index[i]]);
+				grow(bin_min[b], bin_max[b], tri_max[index[i]]);
+			}
+
+			//Sweep from the left to get area & count of everything before each boundary
+			float left_area[BVH_BINS];
+			int left_count[BVH_BINS];
+			Vector lmin(FLOAT_MAX, FLOAT_MAX, FLOAT_MAX), lmax(-FLOAT_MAX, -FLOAT_MAX, -FLOAT_MAX);
+			int sum = 0;
+			for (int b = 0; b < BVH_BINS - 1; b++)
+			{
+				sum += bin_count[b];
+				grow(lmin, lmax, bin_min[b]);
+				grow(lmin, lmax, bin_max[b]);
+				left_count[b] = sum;
+				left_area[b] = half_area(lmin, lmax);
+			}
+
+			//Sweep from the right, cost = area * count of both sides
+			Vector rmin(FLOAT_MAX, FLOAT_MAX, FLOAT_MAX), rmax(-FLOAT_MAX, -FLOAT_MAX, -FLOAT_MAX);
+			sum = 0;
+			for (int b = BVH_BINS - 1; b > 0; b--)
+			{
+				sum += bin_count[b];
+				grow(rmin, rmax, bin_min[b]);
+				grow(rmin, rmax, bin_max[b]);
+				if (left_count[b - 1] == 0 || sum == 0) continue;
+				float cost = left_area[b - 1] * left_count[b - 1] + half_area(rmin, rmax) * sum;
+				if (cost < best_cost)
+				{
+					best_cost = cost;
+					best_axis = axis;
+					best_split = b;
+				}
+			}
+		}
+
+		//Move triangles left of the split to the front of the range
+		int mid;
+		if (best_axis >= 0)
+		{
+			float lo = axis_of(cmin, best_axis);
+			float scale = BVH_BINS / (axis_of(cmax, best_axis) - lo);
+			int* split = std::partition(&index[first], &index[first] + count, [&](int t) {
+				int b = (int)((axis_of(centroid[t], best_axis) - lo) * scale);
+				if (b >= BVH_BINS) b = BVH_BINS - 1;
+				return b < best_split;
+			});
+			mid = (int)(split - &index[0]);
+		}
+		else mid = first + count / 2; //Every centroid is the same point, just cut the range in half
+
+		//Create both children next to each other, then split them too
+		int left = (int)nodes.size();
+		nodes.push_back(BVHNode());
+		nodes.push_back(BVHNode());
+		nodes[left].first = first;
+		nodes[left].count = mid - first;
+		nodes[left + 1].first = mid;
+		nodes[left + 1].count = first + count - mid;
+		nodes[n].first = left;
+		nodes[n].count = 0;
+		todo.push_back(std::make_pair(left + 1, depth + 1));
+		todo.push_back(std::make_pair(left, depth + 1));
+	}
+}
+
+/* Check a BVH that was read from a file instead of built, so a damaged file can't send a search outside the arrays.
+ * One pass in node order: children come after their parent & inside nodes, which also rules out loops, no node is
+ * deeper than the traversal stack holds, and every leaf covers slots of the table. The SIMD kernels read up to
+ * TRI_LANES past a leaf, into the table's padding
+ * slots: Number of triangle slots in the table
+ * Return 1 if the BVH is safe to search, 0 otherwise
+ */
+int BVH::check(int slots) const
+{
+	size_t count = nodes.size();
+	std::vector<int> depth(count, 0);
+	for (size_t n = 0; n < count; n++)
+	{
+		const BVHNode& node = nodes[n];
+		if (node.count > 0)
+		{
+			if (node.first < 0 || node.first > slots - node.count) return 0;
+			continue;
+		}
+		if (node.count < 0 || node.first <= (long)n || (size_t)node.first + 1 >= count || depth[n] + 1 >= BVH_MAX_DEPTH) return 0;
+		depth[node.first] = std::max(depth[node.first], depth[n] + 1);
+		depth[node.first + 1] = std::max(depth[node.first + 1], depth[n] + 1);
+	}
+	return 1;
+}
+
+/* Find where a ray enters a box using the slab method
+ * node: Box being tested
+ * camera: Origin of the ray
+ * inv: 1 / direction of the ray, per axis
+ * zBuffer: Closest hit so far, boxes starting further away are skipped
+ * tnear: Output distance where the ray enters the box
+ * Return 1 if ray passes through the box before zBuffer & not wholly behind its origin, 0 otherwise
+ */
+static int hit_box(const BVHNode& node, const Vector& camera, const Vector& inv, float zBuffer, float& tnear)
+{
+	float t0, t1, tmin, tmax;
+
+	//X slab
+	t0 = (node.min.a - camera.a) * inv.a;
+	t1 = (node.max.a - camera.a) * inv.a;
+	tmin = std::min(t0, t1);
+	tmax = std::max(t0, t1);
+
+	//Y slab
+	t0 = (node.min.b - camera.b) * inv.b;
+	t1 = (node.max.b - camera.b) * inv.b;
+	tmin = std::max(tmin, std::min(t0, t1));
+	tmax = std::min(tmax, std::max(t0, t1));
+
+	//Z slab
+	t0 = (node.min.c - camera.c) * inv.c;
+	t1 = (node.max.c - camera.c) * inv.c;
+	tmin = std::max(tmin, std::min(t0, t1));
+	tmax = std::min(tmax, std::max(t0, t1));
+
+	tnear = tmin;
+	return (tmin <= tmax) && (tmin <= zBuffer) && (tmax >= 0);
+}
+
+/* Safe reciprocal for the slab test. A zero direction gives a huge finite value instead of inf, so 0 * inv never becomes NaN
+ * d: One component of the ray direction
+ */
+static float safe_inv(float d)
+{
+	if (fabs(d) < 1e-30f) return (d < 0) ? -1e30f : 1e30f;
+	return 1.0f / d;
+}
+
+/* Find the closest triangle along the ray from <camera> through <image>
+ * table: Precomputed triangles, slot i holds face index[i]
+ * camera: Origin of the pixel ray
+ * image: 3D coordinates of the image pixel
+ * zBuffer: Closest distance found so far, updated when a closer triangle is found
+ * close_slot: Table slot of the closest triangle found so far, updated with zBuffer
+ * stats: Boxes & triangle tests are added to it
+ */
+void BVH::closest_hit(const TriTable& table, Vector camera, Vector image, float& zBuffer, int& close_slot, RayStats& stats) const
+{
+	const std::vector<int> root(1, 0);
+	if (nodes.empty()) return;
+	closest_hit_nodes(table, root, camera, image, zBuffer, close_slot, stats);
+}
+
+/* Find the closest triangle along the ray from <camera> through <image>, searching only the given subtrees
+ * table: Precomputed triangles, slot i holds face index[i]
+ * start: Subtrees to search, nearest first. Every triangle the ray can hit must be under one of them
+ * camera: Origin of the pixel ray
+ * image: 3D coordinates of the image pixel
+ * zBuffer: Closest distance found so far, updated when a closer triangle is found
+ * close_slot: Table slot of the closest triangle found so far, updated with zBuffer
+ * stats: Boxes & triangle tests are added to it
+ */
+void BVH::closest_hit_nodes(const TriTable& table, const std::vector<int>& start, Vector camera, Vector image, float& zBuffer,
+	int& close_slot, RayStats& stats) const
+{
+	Vector dir = image - camera;
+	Vector inv(safe_inv(dir.a), safe_inv(dir.b), safe_inv(dir.c));
+	TriRay ray(camera, dir);
+	int stack[BVH_MAX_DEPTH + 2];
+	float tnear, tleft, tright;
+
+	for (size_t s = 0; s < start.size(); s++)
+	{
+		int sp = 0;
+		stats.nodes++;
+		if (!hit_box(nodes[start[s]], camera, inv, zBuffer, tnear)) continue;
+		stack[sp++] = start[s];
+		while (sp > 0)
+		{
+			const BVHNode& node = nodes[stack[--sp]];
+
+			//Leaf, test all of its triangles at once
+			if (node.count > 0)
+			{
+				stats.tests += node.count;
+				table.hit_leaf(node.first, node.count, ray, zBuffer, close_slot);
+				continue;
+			}
+
+			//Inner node, visit the nearer child first so zBuffer shrinks sooner
+			int left = node.first, right = node.first + 1;
+			int hit_l = hit_box(nodes[left], camera, inv, zBuffer, tleft);
+			int hit_r = hit_box(nodes[right], camera, inv, zBuffer, tright);
+			stats.nodes += 2;
+			if (hit_l && hit_r)
+			{
+				if (tleft <= tright)
+				{
+					stack[sp++] = right;
+					stack[sp++] = left;
+				}
+				else
+				{
+					stack[sp++] = left;
+					stack[sp++] = right;
+				}
+			}
+			else if (hit_l) stack[sp++] = left;
+			else if (hit_r) stack[sp++] = right;
+		}
+	}
+}
+
+/* Find whether anything lies along a ray, for shadows. Unlike closest_hit() the order triangles are found in doesn't
+ * matter, so children are visited as they come & the search stops at the first leaf with a hit
+ * table: Precomputed triangles, slot i holds face index[i]
+ * origin: Start of the ray, just off the surface it leaves
+ * dir: Direction of the ray, hits up to FAR times its length count
+ * stats: Boxes & triangle tests are added to it
+ * Return 1 if the ray hits a triangle, 0 otherwise
+ */
+int BVH::any_hit(const TriTable& table, Vector origin, Vector dir, RayStats& stats) const
+{
+	Vector inv(safe_inv(dir.a), safe_inv(dir.b), safe_inv(dir.c));
+	TriRay ray(origin, dir);
+	int stack[BVH_MAX_DEPTH + 2];
+	float tnear;
+	int sp = 0;
+
+	if (nodes.empty()) return 0;
+	stats.nodes++;
+	if (!hit_box(nodes[0], origin, inv, FAR, tnear)) return 0;
+	stack[sp++] = 0;
+	while (sp > 0)
+	{
+		const BVHNode& node = nodes[stack[--sp]];
+		if (node.count > 0)
+		{
+			float zBuffer = FAR;
+			int slot = -1;
+			stats.tests += node.count;
+			table.hit_leaf(node.first, node.count, ray, zBuffer, slot);
+			if (slot >= 0) return 1;
+			continue;
+		}
+
+		stats.nodes += 2;
+		if (hit_box(nodes[node.first], origin, inv, FAR, tnear)) stack[sp++] = node.first;
+		if (hit_box(nodes[node.first + 1], origin, inv, FAR, tnear)) stack[sp++] = node.first + 1;
+	}
+	return 0;
+}
+
+/* Test a ray against a box, for boxes that aren't BVH nodes such as whole chunks
+ * origin: Start of the ray
+ * dir: Direction of the ray
+ * min: Box minimum corner
+ * max: Box maximum corner
+ * Return 1 if the ray passes through the box within FAR times its length, 0 otherwise
+ */
+int ray_hits_box(Vector origin, Vector dir, const Vector& min, const Vector& max)
+{
+	BVHNode box;
+	box.min = min;
+	box.max = max;
+	Vector inv(safe_inv(dir.a), safe_inv(dir.b), safe_inv(dir.c));
+	float tnear;
+	return hit_box(box, origin, inv, FAR, tnear);
+}
+
+/* Find the 4 planes of a tile's frustum, each through the camera & two neighboring corner rays
+ * camera: Origin of every pixel ray in the tile
+ * corner: 3D coordinates of the tile's 4 corner pixels, going around the tile
+ * plane: Output normal of each plane, flipped to point into the tile
+ */
+void frustum_planes(Vector camera, const Vector* corner, Vector* plane)
+{
+	Vector mid = (corner[0] + corner[1] + corner[2] + corner[3]) * 0.25f - camera;
+	for (int k = 0; k < 4; k++)
+	{
+		plane[k] = (corner[k] - camera).cross(corner[(k + 1) % 4] - camera);
+		if (v_dot_product(plane[k], mid) < 0) plane[k] = plane[k] * -1.0f;
+	}
+}
+
+/* Test a box against a tile's frustum. A box is outside when its corner furthest along a plane's inward normal
+ * is still behind that plane
+ * plane: Planes from frustum_planes()
+ * camera: Origin of every pixel ray in the tile
+ * min: Box minimum corner
+ * max: Box maximum corner
+ * Return 1 if the box may overlap the frustum, 0 if it is fully outside
+ */
+int box_in_frustum(const Vector* plane, Vector camera, const Vector& min, const Vector& max)
+{
+	for (int k = 0; k < 4; k++)
+	{
+		const Vector& N = plane[k];
+		Vector far((N.a >= 0) ? max.a : min.a, (N.b >= 0) ? max.b : min.b, (N.c >= 0) ? max.c : min.c);
+		if (v_dot_product(N, far - camera) < 0) return 0;
+	}
+	return 1;
+}
+
+/* Find the subtrees that overlap the frustum of a tile, the 4 planes through the camera & the tile's corner rays.
+ * Boxes are opened breadth first until FRUSTUM_NODES are held, so a tile that sees little of the mesh gets a short
+ * list of small boxes & a tile that sees a lot still gets a list no longer than that.
+ * Subtrees come back sorted nearest first, so zBuffer shrinks quickly when they are searched
+ * camera: Origin of every pixel ray in the tile
+ * corner: 3D coordinates of the tile's 4 corner pixels, going around the tile
+ * start: Output node index of every subtree in the frustum, empty if the tile sees nothing
+ */
+void BVH::tile_nodes(Vector camera, const Vector* corner, std::vector<int>& start) const
+{
+	Vector plane[4];
+
+	start.clear();
+	if (nodes.empty()) return;
+	frustum_planes(camera, corner, plane);
+
+	//Open boxes in breadth first order, start[open..] are the ones still to look at
+	start.push_back(0);
+	for (size_t open = 0; open < start.size(); )
+	{
+		const BVHNode& node = nodes[start[open]];
+
+		//Drop the box if it is fully behind any plane
+		if (!box_in_frustum(plane, camera, node.min, node.max))
+		{
+			start[open] = start.back();
+			start.pop_back();
+			continue;
+		}
+
+		//Keep leaves, and every box once the list is full. Otherwise replace the box by its two children
+		if (node.count > 0 || (int)start.size() >= FRUSTUM_NODES)
+		{
+			open++;
+			continue;
+		}
+		int left = node.first;
+		start[open] = left;
+		start.push_back(left + 1);
+	}
+
+	//Nearest box center first
+	std::vector<std::pair<float, int>> order(start.size());
+	for (size_t i = 0; i < start.size(); i++)
+	{
+		Vector d = (nodes[start[i]].min + nodes[start[i]].max) * 0.5f - camera;
+		order[i] = std::make_pair(v_dot_product(d, d), start[i]);
+	}
+	std::sort(order.begin(), order.end());
+	for (size_t i = 0; i < order.size(); i++) start[i] = order[i].second;
+}
@@ -0,0 +1,80 @@
+/* bvh.h
+ * Bounding Volume Hierarchy Library
+ *
+ * Purpose: To speed up the closest triangle search in render2.cpp. Triangles are grouped into nested boxes,
+ *          so a pixel ray only tests the triangles inside boxes it passes through
+ *
+ * Assumptions: User builds the BVH once after parsing the .ply file, then builds a TriTable in BVH::index order for the queries
+ */
+
+#pragma once
+
+#include "render2.h"
+#include "tri_table.h"
+#include "array.h"
+
+#define BVH_LEAF_SIZE TRI_LANES //Most triangles held by one leaf box, one AVX2 step
+#define BVH_BINS 12 //Number of buckets used when searching for the best split
+#define FRUSTUM_NODES 32 //Most subtrees in a tile's candidate list
+
+/* Declare Classes */
+
+//Class counts the work done by closest_hit(). Each job keeps its own, so threads never share a counter
+class RayStats {
+public:
+	long long rays; //Pixel rays cast
+	long long nodes; //Boxes popped off the traversal stack
+	long long tests; //Triangle slots tested in leaves
+	long long hits; //Rays that found a triangle
+	long long culled; //Rays skipped because no box was inside their tile's frustum
+	long long refined; //Edge pixels supersampled with extra rays
+	long long shadows; //Shadow rays cast towards the light
+	long long occluded; //Shadow rays that found something in the way
+
+	RayStats() : rays(0), nodes(0), tests(0), hits(0), culled(0), refined(0), shadows(0), occluded(0) {}
+
+	/* Add another job's counts to this one */
+	void add(const RayStats& other)
+	{
+		rays += other.rays;
+		nodes += other.nodes;
+		tests += other.tests;
+		hits += other.hits;
+		culled += other.culled;
+		refined += other.refined;
+		shadows += other.shadows;
+		occluded += other.occluded;
+	}
+};
+
+//Class holds one box of the hierarchy. Leaves point to triangles, inner nodes point to two children
+class BVHNode {
+public:
+	Vector min, max; //Corners of the bounding box
+	int first; //Leaf: first entry in BVH::index. Inner node: index of left child (right child is first + 1)
+	int count; //Number of triangles in a leaf, 0 for inner nodes
+
+	BVHNode() : first(0), count(0) {}
+};
+
+//Class holds the whole hierarchy as a flat array of nodes, root is nodes[0]
+class BVH {
+public:
+	Array<BVHNode> nodes; //All boxes, children are always stored next to each other
+	Array<int> index; //Triangle indices, reordered so every leaf covers a contiguous range
+
+	/* Member Functions Declarations */
+	void build(const std::vector<Vector>& V, const std::vector<Face>& triangle); //Build hierarchy over every triangle
+	int check(int slots) const; //1 if every child & leaf range of a BVH read from a file is inside the arrays
+	void closest_hit(const TriTable& table, Vector camera, Vector image, float& zBuffer, int& close_slot,
+		RayStats& stats) const; //Find closest triangle along one pixel ray
+	void closest_hit_nodes(const TriTable& table, const std::vector<int>& start, Vector camera, Vector image, float& zBuffer,
+		int& close_slot, RayStats& stats) const; //Closest triangle along a pixel ray, searching only the given subtrees
+	void tile_nodes(Vector camera, const Vector* corner, std::vector<int>& start) const; //Subtrees inside the frustum of a tile
+	int any_hit(const TriTable& table, Vector origin, Vector dir, RayStats& stats) const; //1 if the ray hits any triangle, stops at the first
+};
+
+/* Function Declarations */
+void frustum_planes(Vector camera, const Vector* corner, Vector* plane); //Planes of a tile's frustum, normals point into the tile
+int box_in_frustum(const Vector* plane, Vector camera, const Vector& min, const Vector& max); //0 if a box is fully outside the frustum
+int ray_hits_box(Vector origin, Vector dir, const Vector& min, const Vector& max); //1 if the ray from origin along dir passes through a box
@@ -0,0 +1,450 @@
+/* chunk.cpp
+ * Chunked Scene
+ *
+ * Purpose: To write & read .rchunks files. A file is a fixed header, the chunks one after another & a directory of every
+ *          chunk's box & place at the end. Each chunk holds its BVH nodes, table ids & the 9 corner arrays of its table,
+ *          stored exactly as they sit in memory, so a chunk is one read away from being rendered
+ *
+ * Assumptions: Vector & BVHNode are plain structs of 4 byte fields, checked at compile time.
+ *              A file is only closed once no tile is rendering, chunks still held by someone outlive it safely
+ */
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "render2.h"
+#include "bvh.h"
+#include "tri_table.h"
+#include "chunk.h"
+
+#define CHUNK_MAGIC "RCHUNK\r\n" //First 8 bytes of every file, the CR LF catches text mode mangling
+#define CHUNK_ALIGN 64 //Byte alignment of every chunk & of every array inside one
+#define CHUNK_ARRAYS 11 //BVH nodes, table ids, then v0 x y z, v1 x y z, v2 x y z
+
+static_assert(sizeof(Vector) == 12 && sizeof(BVHNode) == 32, "chunks are stored as they sit in memory");
+
+//Class holds the start of every .rchunks file
+class ChunkHeader {
+public:
+	char magic[8]; //CHUNK_MAGIC
+	uint32_t version; //CHUNK_VERSION
+	uint32_t chunks; //Number of chunks
+	uint64_t vertices, faces; //Size of the whole mesh
+	float min[3], max[3]; //Bounding box of the vertices
+	double origin[3]; //Subtracted from every vertex before the chunks were built
+	uint64_t directory; //Byte offset of the ChunkRecord of every chunk
+};
+
+//Class holds one directory entry of an .rchunks file
+class ChunkRecord {
+public:
+	float min[3], max[3]; //Bounding box of the chunk
+	uint32_t faces, nodes; //Element counts, table arrays hold faces + TRI_LANES padding entries
+	uint64_t offset, bytes; //Place of the chunk in the file
+};
+
+/* Round a byte count up to the next CHUNK_ALIGN boundary
+ * bytes: Count to round
+ */
+static uint64_t align(uint64_t bytes)
+{
+	return (bytes + CHUNK_ALIGN - 1) / CHUNK_ALIGN * CHUNK_ALIGN;
+}
+
+/* Find where each array of a chunk starts, relative to the start of the chunk
+ * faces: Number of faces in the chunk
+ * nodes: Number of BVH nodes of the chunk
+ * offset: Output start of each of the CHUNK_ARRAYS arrays
+ * Return the byte size of the whole chunk
+ */
+static uint64_t chunk_layout(uint64_t faces, uint64_t nodes, uint64_t* offset)
+{
+	uint64_t slots = faces + TRI_LANES;
+	offset[0] = 0;
+	offset[1] = align(nodes * sizeof(BVHNode));
+	for (int k = 2; k < CHUNK_ARRAYS; k++) offset[k] = offset[k - 1] + align(slots * sizeof(float));
+	return offset[CHUNK_ARRAYS - 1] + align(slots * sizeof(float));
+}
+
+/* Write zero bytes until the file reaches the next CHUNK_ALIGN boundary
+ * out: File being written
+ * pos: Current end of the file, moved to the boundary
+ */
+static void pad(std::ofstream& out, uint64_t& pos)
+{
+	static const char zero[CHUNK_ALIGN] = { 0 };
+	uint64_t next = align(pos);
+	out.write(zero, next - pos);
+	pos = next;
+}
+
+/* Split the faces into spatial groups of at most chunk_faces, by cutting the longest axis of the face centers
+ * at the median until every group is small enough. Groups come out in cut order, so neighbors in space stay close in the file
+ * V: Vertices of the mesh
+ * triangle: Faces of the mesh
+ * chunk_faces: Most faces in a group
+ * order: Output face indices, each group is a contiguous range
+ * range: Output first & one past the last position in order of every group
+ */
+static void partition(const std::vector<Vector>& V, const std::vector<Face>& triangle, int chunk_faces, std::vector<int>& order,
+	std::vector<std::pair<int, int>>& range)
+{
+	int n = (int)triangle.size();
+	std::vector<Vector> centroid(n);
+	order.resize(n);
+	for (int i = 0; i < n; i++)
+	{
+		const Face& tri = triangle[i];
+		centroid[i] = (V[tri.v0] + V[tri.v1] + V[tri.v2]) * (1.0f / 3.0f);
+		order[i] = i;
+	}
+
+	//Ranges still to cut, the second half is pushed first so the first half is written first
+	std::vector<std::pair<int, int>> todo;
+	if (n > 0) todo.push_back(std::make_pair(0, n));
+	while (!todo.empty())
+	{
+		int first = todo.back().first, last = todo.back().second;
+		todo.pop_back();
+		if (last - first <= chunk_faces)
+		{
+			range.push_back(std::make_pair(first, last));
+			continue;
+		}
+
+		Vector lo = centroid[order[first]], hi = lo;
+		for (int i = first + 1; i < last; i++)
+		{
+			const Vector& c = centroid[order[i]];
+			lo = Vector(std::min(lo.a, c.a), std::min(lo.b, c.b), std::min(lo.c, c.c));
+			hi = Vector(std::max(hi.a, c.a), std::max(hi.b, c.b), std::max(hi.c, c.c));
+		}
+		Vector e = hi - lo;
+		int axis = (e.a >= e.b && e.a >= e.c) ? 0 : ((e.b >= e.c) ? 1 : 2);
+
+		int mid = first + (last - first) / 2;
+		std::nth_element(order.begin() + first, order.begin() + mid, order.begin() + last, [&](int x, int y) {
+			const Vector& p = centroid[x];
+			const Vector& q = centroid[y];
+			return (axis == 0) ? (p.a < q.a) : ((axis == 1) ? (p.b < q.b) : (p.c < q.c));
+		});
+		todo.push_back(std::make_pair(mid, last));
+		todo.push_back(std::make_pair(first, mid));
+	}
+}
+
+/* Split a mesh into spatial chunks, build a BVH & triangle table for each & write them to an .rchunks file.
+ * Only one chunk's BVH & table are in memory at a time
+ * filename: Name of the new file
+ * V: Vertices of the mesh
+ * triangle: Faces of the mesh
+ * source: Index in the .ply file of every face
+ * chunk_faces: Most faces in one chunk
+ * min: Bounding box minimum of the vertices
+ * max: Bounding box maximum of the vertices
+ * origin: Subtracted from every vertex by PRECISION_LOCAL & PRECISION_DOUBLE
+ * error: Output reason the file couldn't be written
+ * Return 1 on success, 0 on failure
+ */
+int save_chunks(const std::string& filename, const std::vector<Vector>& V, const std::vector<Face>& triangle,
+	const std::vector<int>& source, int chunk_faces, Vector min, Vector max, DVector origin, std::string& error)
+{
+	std::ofstream out(filename, std::ios::binary);
+	if (!out.is_open())
+	{
+		error = "Could not create " + filename;
+		return 0;
+	}
+
+	std::vector<int> order;
+	std::vector<std::pair<int, int>> range;
+	partition(V, triangle, std::max(chunk_faces, 1), order, range);
+
+	ChunkHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CHUNK_MAGIC, 8);
+	header.version = CHUNK_VERSION;
+	header.chunks = (uint32_t)range.size();
+	header.vertices = V.size();
+	header.faces = triangle.size();
+	header.min[0] = min.a; header.min[1] = min.b; header.min[2] = min.c;
+	header.max[0] = max.a; header.max[1] = max.b; header.max[2] = max.c;
+	header.origin[0] = origin.a; header.origin[1] = origin.b; header.origin[2] = origin.c;
+
+	//Header is written twice, first to hold the space & again once the directory is placed
+	uint64_t pos = sizeof(header);
+	out.write((const char*)&header, sizeof(header));
+	std::vector<ChunkRecord> record(range.size());
+	for (size_t g = 0; g < range.size(); g++)
+	{
+		//Faces of the chunk keep their vertex indices, the BVH & table only read the vertices they use
+		std::vector<Face> part;
+		std::vector<int> part_source;
+		for (int i = range[g].first; i < range[g].second; i++)
+		{
+			part.push_back(triangle[order[i]]);
+			part_source.push_back(source[order[i]]);
+		}
+		BVH bvh;
+		TriTable table;
+		bvh.build(V, part);
+		table.build(V, part, bvh.index, part_source);
+
+		pad(out, pos);
+		uint64_t offset[CHUNK_ARRAYS];
+		ChunkRecord& r = record[g];
+		r.faces = (uint32_t)part.size();
+		r.nodes = (uint32_t)bvh.nodes.size();
+		r.offset = pos;
+		r.bytes = chunk_layout(r.faces, r.nodes, offset);
+		const BVHNode& root = bvh.nodes[0];
+		r.min[0] = root.min.a; r.min[1] = root.min.b; r.min[2] = root.min.c;
+		r.max[0] = root.max.a; r.max[1] = root.max.b; r.max[2] = root.max.c;
+
+		//Arrays in layout order, each padded to the start of the next
+		const Array<float>* corner[3] = { table.v0, table.v1, table.v2 };
+		out.write((const char*)bvh.nodes.data(), bvh.nodes.size() * sizeof(BVHNode));
+		pos += bvh.nodes.size() * sizeof(BVHNode);
+		pad(out, pos);
+		out.write((const char*)table.id.data(), table.id.size() * sizeof(int));
+		pos += table.id.size() * sizeof(int);
+		for (int k = 0; k < 9; k++)
+		{
+			const Array<float>& axis = corner[k / 3][k % 3];
+			pad(out, pos);
+			out.write((const char*)axis.data(), axis.size() * sizeof(float));
+			pos += axis.size() * sizeof(float);
+		}
+		pad(out, pos);
+	}
+
+	header.directory = pos;
+	out.write((const char*)record.data(), record.size() * sizeof(ChunkRecord));
+	out.seekp(0);
+	out.write((const char*)&header, sizeof(header));
+	out.close();
+	if (!out.good())
+	{
+		error = "Could not write " + filename;
+		return 0;
+	}
+	return 1;
+}
+
+/* Open an .rchunks file & read its directory. No chunk is read until a tile asks for it
+ * filename: File to open
+ * bytes: Most bytes of chunks to cache
+ * error: Output reason the file couldn't be opened
+ * Return 1 on success, 0 on failure
+ */
+int ChunkCache::open(const std::string& filename, size_t bytes, std::string& error)
+{
+	close();
+	fd = ::open(filename.c_str(), O_RDONLY);
+	struct stat info;
+	if (fd < 0 || fstat(fd, &info) != 0)
+	{
+		close();
+		error = "Could not open " + filename;
+		return 0;
+	}
+
+	ChunkHeader header;
+	uint64_t size = (uint64_t)info.st_size;
+	if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) || memcmp(header.magic, CHUNK_MAGIC, 8) != 0)
+	{
+		close();
+		error = filename + " is not an .rchunks file";
+		return 0;
+	}
+	if (header.version != CHUNK_VERSION)
+	{
+		close();
+		error = filename + " was written by a different version of render2, export it again";
+		return 0;
+	}
+
+	//Directory & every chunk must be inside the file & as big as their counts say
+	std::vector<ChunkRecord> record(header.chunks);
+	size_t directory = record.size() * sizeof(ChunkRecord);
+	bool damaged = header.directory > size || directory > size - header.directory
+		|| pread(fd, record.data(), directory, header.directory) != (ssize_t)directory;
+	for (size_t g = 0; g < record.size() && !damaged; g++)
+	{
+		uint64_t offset[CHUNK_ARRAYS];
+		const ChunkRecord& r = record[g];
+		damaged = r.nodes == 0 || r.bytes != chunk_layout(r.faces, r.nodes, offset) || r.offset % CHUNK_ALIGN != 0
+			|| r.offset > size || r.bytes > size - r.offset;
+	}
+	if (damaged)
+	{
+		close();
+		error = filename + " is truncated or damaged";
+		return 0;
+	}
+
+	vertices = (int)header.vertices;
+	faces = (int)header.faces;
+	min = Vector(header.min[0], header.min[1], header.min[2]);
+	max = Vector(header.max[0], header.max[1], header.max[2]);
+	origin = DVector(header.origin[0], header.origin[1], header.origin[2]);
+	budget = bytes;
+	entry.resize(record.size());
+	nodes = 0;
+	for (size_t g = 0; g < record.size(); g++)
+	{
+		const ChunkRecord& r = record[g];
+		entry[g].min = Vector(r.min[0], r.min[1], r.min[2]);
+		entry[g].max = Vector(r.max[0], r.max[1], r.max[2]);
+		entry[g].faces = (int)r.faces;
+		entry[g].nodes = (int)r.nodes;
+		entry[g].offset = r.offset;
+		entry[g].bytes = r.bytes;
+		nodes += entry[g].nodes;
+	}
+	held.assign(entry.size(), std::shared_ptr<const Chunk>());
+	place.assign(entry.size(), order.end());
+	return 1;
+}
+
+/* Drop every cached chunk & close the file. Safe to call more than once */
+void ChunkCache::close()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	order.clear();
+	held.clear();
+	place.clear();
+	entry.clear();
+	cached = 0;
+	if (fd >= 0) ::close(fd);
+	fd = -1;
+}
+
+/* Read one chunk into its own buffer, then point its BVH & table into the buffer. The nodes are checked before use,
+ * the table holds corners & face ids only, so no index in it can point outside the chunk
+ * k: Chunk to read
+ * chunk: Output chunk
+ * Return 1 on success, 0 if the file couldn't be read or the chunk's BVH is damaged
+ */
+int ChunkCache::read_chunk(int k, Chunk& chunk)
+{
+	const ChunkEntry& e = entry[k];
+	chunk.buffer.resize(e.bytes / sizeof(float));
+	char* data = (char*)chunk.buffer.data();
+	for (uint64_t done = 0; done < e.bytes; )
+	{
+		ssize_t n = pread(fd, data + done, e.bytes - done, e.offset + done);
+		if (n <= 0) return 0;
+		done += n;
+	}
+
+	uint64_t offset[CHUNK_ARRAYS];
+	size_t slots = (size_t)e.faces + TRI_LANES;
+	chunk_layout(e.faces, e.nodes, offset);
+	chunk.bvh.nodes.borrow((const BVHNode*)(data + offset[0]), e.nodes);
+	if (!chunk.bvh.check(e.faces)) return 0;
+	chunk.table.count = e.faces;
+	chunk.table.id.borrow((const int*)(data + offset[1]), slots);
+	Array<float>* corner[3] = { chunk.table.v0, chunk.table.v1, chunk.table.v2 };
+	for (int a = 0; a < 9; a++) corner[a / 3][a % 3].borrow((const float*)(data + offset[2 + a]), slots);
+	chunk.table.set_kernel(kernel);
+	chunk.table.cull = cull;
+	return 1;
+}
+
+/* Find a chunk, reading it from the file unless it is cached. The new chunk goes to the front of the cache,
+ * then the least recently used chunks are dropped until the cache fits its budget again. A tile still holding a
+ * dropped chunk keeps it alive until the tile is done
+ * k: Chunk to find
+ * Return the chunk, NULL if it couldn't be read
+ */
+std::shared_ptr<const Chunk> ChunkCache::get(int k)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (held[k])
+		{
+			order.splice(order.begin(), order, place[k]);
+			counts.reuses++;
+			return held[k];
+		}
+	}
+
+	//Read outside the lock so other tiles keep going. Every chunk in memory is counted in live until it is freed
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t bytes = entry[k].bytes;
+	std::atomic<size_t>* counter = &live;
+	std::shared_ptr<Chunk> chunk(new Chunk, [counter, bytes](Chunk* c) {
+		*counter -= bytes;
+		delete c;
+	});
+	*counter += bytes;
+	int ok = read_chunk(k, *chunk);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::lock_guard<std::mutex> guard(lock);
+	counts.read += seconds;
+	if (!ok)
+	{
+		counts.failed++;
+		return NULL;
+	}
+	if (held[k]) //Another tile read it at the same time, keep theirs
+	{
+		counts.reuses++;
+		return held[k];
+	}
+	counts.loads++;
+	counts.peak = std::max(counts.peak, live.load());
+
+	order.push_front(k);
+	place[k] = order.begin();
+	held[k] = chunk;
+	cached += bytes;
+	while (cached > budget && order.size() > 1)
+	{
+		int last = order.back();
+		order.pop_back();
+		cached -= entry[last].bytes;
+		held[last].reset();
+		counts.evictions++;
+	}
+	return chunk;
+}
+
+/* Find the chunks whose boxes overlap a tile's frustum, nearest box center first so zBuffer shrinks quickly
+ * camera: Origin of every pixel ray in the tile
+ * corner: 3D coordinates of the tile's 4 corner pixels, going around the tile
+ * list: Output chunk numbers, empty if the tile sees nothing
+ */
+void ChunkCache::tile_chunks(Vector camera, const Vector* corner, std::vector<int>& list) const
+{
+	Vector plane[4];
+	frustum_planes(camera, corner, plane);
+
+	std::vector<std::pair<float, int>> near;
+	for (size_t g = 0; g < entry.size(); g++)
+	{
+		if (!box_in_frustum(plane, camera, entry[g].min, entry[g].max)) continue;
+		Vector d = (entry[g].min + entry[g].max) * 0.5f - camera;
+		near.push_back(std::make_pair(v_dot_product(d, d), (int)g));
+	}
+	std::sort(near.begin(), near.end());
+
+	list.clear();
+	for (size_t i = 0; i < near.size(); i++) list.push_back(near[i].second);
+}
+
+/* Copy the counts of the cache, safe while tiles are reading */
+ChunkStats ChunkCache::stats()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return counts;
+}
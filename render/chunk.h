@@ -0,0 +1,104 @@
+/* chunk.h
+ * Chunked Scene Library
+ *
+ * Purpose: To render meshes that don't fit in memory. save_chunks() splits a mesh into spatial chunks, each with its own
+ *          bounding box, BVH & triangle table, and writes them to one .rchunks file. A ChunkCache opens that file keeping
+ *          only the chunk boxes in memory, and reads the chunks a tile's rays can reach when the tile asks for them.
+ *          At most a fixed number of bytes of chunks are cached, the least recently used ones are dropped first
+ *
+ * Assumptions: Files are read on a machine with the same byte order & float format that wrote them. POSIX system (pread)
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include "render2.h"
+#include "bvh.h"
+#include "tri_table.h"
+
+#define CHUNK_FACES 65536 //Default most faces in one chunk
+#define CHUNK_CACHE 256 //Default megabytes of chunks held in memory
+#define CHUNK_VERSION 1 //Bumped whenever the layout changes, older files are refused
+
+/* Declare Classes */
+
+//Class holds one chunk read from the file. The BVH & table borrow their arrays from the chunk's buffer
+class Chunk {
+public:
+	BVH bvh; //Hierarchy over the chunk's faces
+	TriTable table; //Corners of the chunk's faces in BVH order, ids are .ply face indices
+	std::vector<float> buffer; //Chunk as stored in the file, floats keep every array 4 byte aligned
+};
+
+//Class holds where one chunk sits in the file & what it covers. Every chunk has one in memory
+class ChunkEntry {
+public:
+	Vector min, max; //Bounding box of the chunk's faces, the root box of its BVH
+	int faces; //Number of faces
+	int nodes; //Number of BVH nodes
+	uint64_t offset; //Byte offset of the chunk in the file
+	uint64_t bytes; //Byte size of the chunk
+};
+
+//Class counts what the cache did
+class ChunkStats {
+public:
+	long long loads; //Chunks read from the file
+	long long reuses; //Requests served from memory
+	long long evictions; //Chunks dropped to stay inside the budget
+	long long failed; //Chunks that couldn't be read, their faces are missing from the image
+	size_t peak; //Most bytes of chunks in memory at once, counting evicted ones tiles still held
+	double read; //Seconds spent reading chunks
+
+	ChunkStats() : loads(0), reuses(0), evictions(0), failed(0), peak(0), read(0) {}
+};
+
+//Class holds an open .rchunks file & the chunks of it in memory
+class ChunkCache {
+public:
+	std::vector<ChunkEntry> entry; //Every chunk in the file
+	int vertices, faces, nodes; //Size of the whole mesh & of every chunk's BVH together
+	Vector min, max; //Bounding box of the vertices
+	DVector origin; //Subtracted from every vertex before the file was written, 0 for PRECISION_FLOAT
+	int kernel; //Kernel every loaded table uses
+	int cull; //1 to skip triangles facing away from the camera
+	size_t budget; //Most bytes of chunks the cache holds
+
+	/* Constructors */
+	ChunkCache() : vertices(0), faces(0), nodes(0), kernel(KERNEL_SCALAR), cull(0), budget(0), fd(-1), cached(0), live(0) {}
+	~ChunkCache() { close(); }
+	ChunkCache(const ChunkCache&) = delete; //Owns the file, no copies
+	ChunkCache& operator=(const ChunkCache&) = delete;
+
+	/* Member Functions Declarations */
+	int open(const std::string& filename, size_t bytes, std::string& error); //Read the chunk boxes of a file, return 1 on success
+	void close(); //Drop every chunk & close the file
+	bool is_open() const { return fd >= 0; } //1 once a file is open
+	std::shared_ptr<const Chunk> get(int k); //Chunk k, read from the file unless it is cached. NULL if it couldn't be read
+	void tile_chunks(Vector camera, const Vector* corner, std::vector<int>& list) const; //Chunks inside a tile's frustum
+	ChunkStats stats(); //What the cache did so far
+	size_t resident() const { return live; } //Bytes of chunks in memory right now
+
+private:
+	int fd; //File descriptor of the open file, -1 if none
+	std::mutex lock; //Guards everything below
+	std::list<int> order; //Cached chunks, most recently used first
+	std::vector<std::shared_ptr<const Chunk>> held; //Cached copy of every chunk, NULL if it isn't cached
+	std::vector<std::list<int>::iterator> place; //Where each cached chunk is in order
+	size_t cached; //Bytes of the cached chunks
+	std::atomic<size_t> live; //Bytes of every chunk in memory, cached or only held by a tile
+	ChunkStats counts; //Loads, reuses & evictions so far
+
+	int read_chunk(int k, Chunk& chunk); //Read chunk k from the file & point its BVH & table into it
+};
+
+/* Function Declarations */
+int save_chunks(const std::string& filename, const std::vector<Vector>& V, const std::vector<Face>& triangle,
+	const std::vector<int>& source, int chunk_faces, Vector min, Vector max, DVector origin,
+	std::string& error); //Split a mesh into chunks & write them to an .rchunks file. Return 1 on success
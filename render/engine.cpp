@@ -0,0 +1,1065 @@
+/* engine.cpp
+ * Render Engine
+ *
+ * Purpose: To run the pipeline both front-ends share: vector math, camera setup, the per pixel ray cast,
+ *          the tile loop, image writers & the Engine class that ties them together
+ *
+ * Assumptions: Engine::load() is called once before any view is rendered. Everything here used to live in render2.cpp
+ */
+
+#include <iostream> 
+#include <cstdlib>
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+#include <fstream> 
+#include <string>
+#include <cmath> 
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include "render2.h" 
+#include "tri_table.h"
+#include "bvh.h"
+#include "ply.h"
+#include "mesh.h"
+#include "scene.h"
+#include "raster.h"
+#include "thread_pool.h"
+#include "chunk.h"
+#include "engine.h"
+
+/* Find max vector
+ * V: A structure holding all the given input vertices
+ * vertices: The amount of vertices in the input file
+ */
+template <typename T>
+Vec3<T> v_max(const std::vector<Vec3<T>>& V, int vertices)
+{
+	//Assign min variable to hold temporarily
+	T max_A = -std::numeric_limits<T>::max();
+	T max_B = -std::numeric_limits<T>::max();
+	T max_C = -std::numeric_limits<T>::max();
+
+	//Go through all vertices, find max of each element
+	for (int i = 0; i < vertices; i++)
+	{
+		if (max_A < V[i].a) max_A = V[i].a;
+		if (max_B < V[i].b) max_B = V[i].b;
+		if (max_C < V[i].c) max_C = V[i].c;
+	}
+
+	//Found max, assign into given array 
+	return Vec3<T>(max_A, max_B, max_C);
+}
+
+/* Find min vector
+ * V: A structure holding all the given input vertices
+ * vertices: The amount of vertices in the input file
+ */
+template <typename T>
+Vec3<T> v_min(const std::vector<Vec3<T>>& V, int vertices)
+{
+	//Assign max variable to hold temporarily
+	T min_A = std::numeric_limits<T>::max();
+	T min_B = std::numeric_limits<T>::max();
+	T min_C = std::numeric_limits<T>::max();
+
+	//Go through all vertices, find min of each element
+	for (int i = 0; i < vertices; i++)
+	{
+		if (min_A > V[i].a) min_A = V[i].a;
+		if (min_B > V[i].b) min_B = V[i].b;
+		if (min_C > V[i].c) min_C = V[i].c;
+	}
+
+	//Found min, assign into given array 
+	return Vec3<T>(min_A, min_B, min_C);
+}
+
+/* Find center vector (min + max)/2
+ * max: Given vector to hold maximum x,y,z values
+ * min: Given vector to hold minimum x,y,z values
+ */
+template <typename T>
+Vec3<T> v_center(Vec3<T> max, Vec3<T> min)
+{
+	return Vec3<T>((max.a + min.a) / 2, (max.b + min.b) / 2, (max.c + min.c) / 2);
+}
+
+/* Find E scalar of bounding box, largest component of <max-min> or largest extent of the three axes
+ * max: Given vertex to hold maximum x,y,z values
+ * min: Given vertex to hold minimum x,y,z values
+ */
+template <typename T>
+T find_e(Vec3<T> max, Vec3<T> min)
+{
+	//Assign temporary value for e
+	T e = -std::numeric_limits<T>::max();
+
+	//Grab extents of each axis
+	T temp_X = max.a - min.a;
+	T temp_Y = max.b - min.b;
+	T temp_Z = max.c - min.c;
+
+	//Find largest extent 
+	e = temp_X;
+	if (e < temp_Y) e = temp_Y;
+	if (e < temp_Z) e = temp_Z;
+
+	return e;
+}
+
+/* Create Rotation matrix by multiplying a 3x3 matrix by another 3x3 matrix. Output is a 3x3 matrix
+ * R: Our output matrix, stores the product of the two input matrices
+ * R1: One of the input matrices. First one R1*R2
+ * R2: One of the input matrices. Second one R1*R2
+ */
+template <typename T>
+void create_rotate(T R[3][3], T R1[3][3], T R2[3][3])
+{
+	//Go through entire 3x3 matrix. Go through each row at a time
+	for (int i = 0; i < 3; i++)
+	{
+		//Set to zero to allow for incrementation
+		R[i][0] = 0;
+		R[i][1] = 0;
+		R[i][2] = 0;
+
+		//Go through each column in the row, adding all the multiplications between the two matrices
+		for (int j = 0; j < 3; j++)
+		{
+			R[i][0] += R1[i][j] * R2[j][0];
+			R[i][1] += R1[i][j] * R2[j][1];
+			R[i][2] += R1[i][j] * R2[j][2];
+		}
+	}
+}
+
+/* Apply rotation by multiplying a 3x3 matrix by a 3x1 matrix. Output is a 3x1 matrix that is rotated around all axes (XYZ)
+ * product: Our output matrix, stores the product of the two input matrices
+ * R: Input 3x3 matrix. First matrix in the multiplication order
+ * V: Input 3x1 matrix. Second matrix in the multiplication order 
+ * Note: Wish I kept this in original C implementation, but doesn't hurt to practice
+ */
+template <typename T>
+void v_rotate(Vec3<T>& product, T R[3][3], Vec3<T> V)
+{ 
+	//Go through entire 3x3 matrix. Go through each row at a time
+	product.a = (R[0][0] * V.a) + (R[0][1] * V.b) + (R[0][2] * V.c);
+	product.b = (R[1][0] * V.a) + (R[1][1] * V.b) + (R[1][2] * V.c);
+	product.c = (R[2][0] * V.a) + (R[2][1] * V.b) + (R[2][2] * V.c);
+}
+
+/* Rotate the camera & up vectors by the given degrees
+ * cam: Provided camera vector that will be rotated. Default <1, 0, 0>
+ * up: Provided up vector that will be rotated. Default <0, 0, 1>
+ * X: Degrees that camera & up vectors will be rotated about the X axis, given by user input
+ * Y: Degrees that camera & up vectors will be rotated about the Y axis, given by user input
+ * Z: Degrees that camera & up vectors will be rotated about the Z axis, given by user input
+ */
+template <typename T>
+void rotate(Vec3<T>& cam, Vec3<T>& up, T X, T Y, T Z)
+{
+	//Convert degree input into radians for cmath trig functions 
+	T radX = X * (PI / 180.0);
+	T radY = Y * (PI / 180.0);
+	T radZ = Z * (PI / 180.0);
+
+	//Set up rotation matrix for X, Y, Z. std::cos & std::sin pick cosf & sinf for floats
+	T Rx[3][3] = { {1, 0, 0}, {0, std::cos(radX), -std::sin(radX)}, {0, std::sin(radX), std::cos(radX)} };
+	T Ry[3][3] = { {std::cos(radY), 0, std::sin(radY)}, {0, 1, 0}, {-std::sin(radY), 0, std::cos(radY)} };
+	T Rz[3][3] = { {std::cos(radZ), -std::sin(radZ), 0}, {std::sin(radZ), std::cos(radZ), 0}, {0, 0, 1} };
+
+	//Create matrices to store products & old vectors for purposes of matrix multiplication
+	T R[3][3], temp_R[3][3]; 
+
+	//Create temporary arrays to hold old cam/up vectors
+	Vec3<T> temp_cam = Vec3<T>(cam.a, cam.b, cam.c);  
+	Vec3<T> temp_up = Vec3<T>(up.a, up.b, up.c);
+
+
+	//Find rotation matrix Rz*(Ry*Rx)
+	create_rotate(temp_R, Ry, Rx); //Ry * Rx
+	create_rotate(R, Rz, temp_R); //Rz * (Ry * Rx) 
+
+	//Rotate camera & up vectors around the X-axis, Y-axis, Z-axis
+	v_rotate(cam, R, temp_cam);
+	v_rotate(up, R, temp_up);
+}
+
+/* Find vertices for a point on the triangle, depending on the vector index & vector table
+ * v: Output 3x1 matrix, will be assigned vertices depending on found vector
+ * table: Table that stores all vertices from .ply file
+ * index: Specific vector that the face from .ply file wants, to assign vertice for triangle edge
+ */
+Vector find_vector(const std::vector<Vector>& table, int index)
+{
+	return Vector(table[index].a, table[index].b, table[index].c);
+}
+
+/* Find the 3D coordinates of image pixel r,c. Fractions of a pixel are allowed, for supersampling
+ * view: Camera & the 3D coordinates bounding the image
+ * r: Row of the pixel
+ * c: Column of the pixel
+ */
+static Vector pixel_image(const View& view, float r, float c)
+{
+	Vector diff, diff1, sum;
+
+	diff = view.bottom - view.top; //<diff> = <bottom - top> 
+	diff = diff * (r / view.row_span); //[r/(ROWS-1)]<bottom - top> 
+	diff1 = view.right - view.left; //<diff1> = <right-left>  
+	diff1 = diff1 * (c / view.col_span); //<diff1> = c/(COLS-1)<right-left> 
+	sum = diff1 + diff;//<sum> = c/(COLS-1)<right-left> + r/(ROWS-1)<bottom - top>
+	return view.top_left + sum;//<image> = <topleft> + c/(COLS-1)<right-left> + r/(ROWS-1)<bottom - top>  
+}
+
+//Class holds one BVH & table the rays of a tile search, with the subtrees of it they can reach
+class TilePart {
+public:
+	const BVH* bvh; //Hierarchy to search
+	const TriTable* table; //Triangles the hierarchy points to
+	std::vector<int> start; //Subtrees inside the tile's frustum, or just the root
+	std::shared_ptr<const Chunk> chunk; //Keeps a chunk in memory while the tile uses it, NULL for the whole model
+
+	TilePart() : bvh(NULL), table(NULL) {}
+};
+
+//Class holds how hit pixels are shaded, and what shadow rays search
+class Shading {
+public:
+	int shade; //SHADE_INDEX or SHADE_LAMBERT
+	int shadows; //1 to cast a shadow ray from every lit hit, SHADE_LAMBERT only
+	Vector light; //Unit direction towards the light
+	float reach; //Length of a shadow ray's direction, the model size, so FAR of them always leaves the model
+	const BVH* bvh; //Hierarchy of the whole model, shadow rays leave the tile's frustum
+	const TriTable* table; //Triangles the hierarchy points to
+	ChunkCache* chunks; //Open .rchunks file, NULL to search bvh & table
+
+	Shading() : shade(SHADE_INDEX), shadows(0), reach(1), bvh(NULL), table(NULL), chunks(NULL) {}
+};
+
+/* Gather what the rays of one tile search. In memory that is the whole BVH, out of core it is every chunk whose box
+ * overlaps the tile's frustum, read through the cache & held until the tile is done
+ * table: Precomputed triangles of the whole model, in BVH order
+ * bvh: Hierarchy built over the whole model
+ * chunks: Open .rchunks file, NULL to render from table & bvh
+ * camera: Origin of every pixel ray in the tile
+ * corner: 3D coordinates of the tile's 4 corners, going around the tile
+ * frustum: 1 to keep only the subtrees inside the tile's frustum, 0 to search from each root. Chunks are always picked by frustum
+ * part: Output BVHs to search, nearest first. Empty if the tile sees nothing
+ */
+static void tile_parts(const TriTable& table, const BVH& bvh, ChunkCache* chunks, Vector camera, const Vector* corner, int frustum,
+	std::vector<TilePart>& part)
+{
+	std::vector<int> list;
+	part.clear();
+	if (chunks == NULL)
+	{
+		if (bvh.nodes.empty()) return;
+		part.resize(1);
+		part[0].bvh = &bvh;
+		part[0].table = &table;
+	}
+	else
+	{
+		chunks->tile_chunks(camera, corner, list);
+		for (size_t i = 0; i < list.size(); i++)
+		{
+			TilePart piece;
+			piece.chunk = chunks->get(list[i]);
+			if (!piece.chunk) continue; //Couldn't be read, counted by the cache
+			piece.bvh = &piece.chunk->bvh;
+			piece.table = &piece.chunk->table;
+			part.push_back(std::move(piece));
+		}
+	}
+
+	//Drop the parts with nothing inside the frustum
+	size_t kept = 0;
+	for (size_t i = 0; i < part.size(); i++)
+	{
+		if (frustum) part[i].bvh->tile_nodes(camera, corner, part[i].start);
+		else part[i].start.assign(1, 0);
+		if (!part[i].start.empty()) std::swap(part[kept++], part[i]);
+	}
+	part.resize(kept);
+}
+
+/* Find the closest triangle along one pixel ray, over every part of its tile. A later part only wins with a closer hit,
+ * or an equally close one of a lower face index, so chunks pick the same triangle one BVH over the whole model would
+ * part: BVHs from tile_parts(), nearest first
+ * camera: Origin of the pixel ray
+ * image: 3D coordinates of the image pixel
+ * zBuffer: Closest distance found so far, updated when a closer triangle is found
+ * close_slot: Slot of the closest triangle in the returned table
+ * stats: Ray, box & triangle test counts are added to it
+ * Return the table holding the closest triangle, NULL if the ray hits nothing
+ */
+static const TriTable* trace(const std::vector<TilePart>& part, Vector camera, Vector image, float& zBuffer, int& close_slot,
+	RayStats& stats)
+{
+	stats.rays++;
+	if (part.empty())
+	{
+		stats.culled++; //Nothing in the tile's frustum
+		return NULL;
+	}
+	if (part.size() == 1)
+	{
+		part[0].bvh->closest_hit_nodes(*part[0].table, part[0].start, camera, image, zBuffer, close_slot, stats);
+		return (close_slot >= 0) ? part[0].table : NULL;
+	}
+
+	const TriTable* close_table = NULL;
+	for (size_t i = 0; i < part.size(); i++)
+	{
+		//One step past zBuffer lets a tie through, the face indices settle it
+		float z = (close_table == NULL) ? zBuffer : std::nextafter(zBuffer, INFINITY);
+		int slot = -1;
+		part[i].bvh->closest_hit_nodes(*part[i].table, part[i].start, camera, image, z, slot, stats);
+		if (slot < 0) continue;
+		if (close_table == NULL || z < zBuffer || part[i].table->id[slot] < close_table->id[close_slot])
+		{
+			zBuffer = z;
+			close_slot = slot;
+			close_table = part[i].table;
+		}
+	}
+	return close_table;
+}
+
+/* Find whether the light is blocked from a point, with an any-hit search of the whole model. Out of core only the chunks
+ * the shadow ray passes through are read
+ * light: Light direction & what to search
+ * origin: Point on a surface, already moved off it towards the light
+ * stats: Shadow ray, box & triangle test counts are added to it
+ * Return 1 if something is in the way, 0 if the point is lit
+ */
+static int in_shadow(const Shading& light, Vector origin, RayStats& stats)
+{
+	Vector dir = light.light * light.reach;
+	int blocked = 0;
+	stats.shadows++;
+	if (light.chunks == NULL) blocked = light.bvh->any_hit(*light.table, origin, dir, stats);
+	for (size_t g = 0; light.chunks != NULL && g < light.chunks->entry.size() && !blocked; g++)
+	{
+		const ChunkEntry& e = light.chunks->entry[g];
+		if (!ray_hits_box(origin, dir, e.min, e.max)) continue;
+		std::shared_ptr<const Chunk> chunk = light.chunks->get((int)g);
+		if (chunk) blocked = chunk->bvh.any_hit(chunk->table, origin, dir, stats);
+	}
+	if (blocked) stats.occluded++;
+	return blocked;
+}
+
+/* Find the grey value of a hit. SHADE_INDEX varies it by face index, so neighbors can be told apart.
+ * SHADE_LAMBERT lights the face from one direction, both sides alike, with AMBIENT where the light doesn't reach
+ * light: How to shade & what shadow rays search
+ * table: Table holding the hit triangle
+ * slot: Slot of the hit triangle
+ * camera: Origin of the pixel ray
+ * image: 3D coordinates of the image pixel
+ * zBuffer: Distance of the hit, in units of <image - camera>
+ * stats: Shadow ray counts are added to it
+ */
+static int shade(const Shading& light, const TriTable& table, int slot, Vector camera, Vector image, float zBuffer, RayStats& stats)
+{
+	if (light.shade == SHADE_INDEX) return 155 + (table.id[slot] % 100);
+
+	//Normal turned towards the camera, so meshes wound either way shade the same
+	Vector dir = image - camera;
+	Vector N = table.normal(slot);
+	if (v_dot_product(N, dir) > 0) N = N * -1.0f;
+	float lit = v_dot_product(N, light.light);
+	if (lit <= 0) return (int)lrintf(255 * AMBIENT);
+
+	//Shadow ray starts just off the surface, so it can't hit the face it leaves
+	if (light.shadows && in_shadow(light, camera + dir * zBuffer + N * (SHADOW_EPS * light.reach), stats))
+	{
+		return (int)lrintf(255 * AMBIENT);
+	}
+	return (int)lrintf(255 * (AMBIENT + (1 - AMBIENT) * lit));
+}
+
+/* Find the color of image pixel r,c, and its depth, face index & normal when the image has those buffers
+ * part: BVHs the pixel's tile searches, from tile_parts()
+ * light: How to shade the pixel
+ * view: Camera & the 3D coordinates bounding the image
+ * r: Row of the pixel
+ * c: Column of the pixel
+ * out: Image the pixel is written to
+ * stats: Ray, box & triangle test counts are added to it
+ */
+static void render_pixel(const std::vector<TilePart>& part, const Shading& light, const View& view, int r, int c, Framebuffer& out,
+	RayStats& stats)
+{
+	float zBuffer = FAR; //Default the zBuffer to far away for each pixel before checking triangles 
+	int close_slot = -1; //Default slot to impossible value, meant to distinguish if any triangle is found or not
+	size_t p = (size_t)r * out.width + c;
+	Vector image = pixel_image(view, r, c);
+
+	//Find the closest triangle seen by this pixel ray, BVH skips every box the ray misses
+	const TriTable* table = trace(part, view.camera, image, zBuffer, close_slot, stats);
+
+	//Triangle not found, set to background color
+	if (table == NULL)
+	{
+		out.pixel[p] = BLACK;
+		if (out.depth != NULL) out.depth[p] = INFINITY;
+		if (out.id != NULL) out.id[p] = -1;
+		if (out.normal != NULL) memset(out.normal + 3 * p, 0, 3);
+		return;
+	}
+
+	//Triangle found, set to its greyscale value
+	int close_tri = table->id[close_slot];
+	stats.hits++;
+	out.pixel[p] = shade(light, *table, close_slot, view.camera, image, zBuffer, stats);
+
+	//zBuffer counts in steps of <image - camera>, the depth buffer holds the real distance
+	if (out.depth != NULL)
+	{
+		Vector dir = image - view.camera;
+		out.depth[p] = zBuffer * sqrtf(v_dot_product(dir, dir));
+	}
+	if (out.id != NULL) out.id[p] = close_tri;
+	if (out.normal != NULL)
+	{
+		Vector N = table->normal(close_slot);
+		out.normal[3 * p] = (unsigned char)lrintf(127.5f * (N.a + 1));
+		out.normal[3 * p + 1] = (unsigned char)lrintf(127.5f * (N.b + 1));
+		out.normal[3 * p + 2] = (unsigned char)lrintf(127.5f * (N.c + 1));
+	}
+}
+
+/* Render one or more images, each split into TILE x TILE blocks of pixels. Every tile of every image is one job
+ * for the thread pool, so several views of the same scene render side by side
+ * pool: Threads that share the tiles
+ * table: Precomputed triangles, in BVH order
+ * bvh: Hierarchy built over the faces, shared by every view
+ * chunks: Open .rchunks file, NULL to render from table & bvh
+ * light: How to shade hit pixels
+ * view: Camera & the 3D coordinates bounding each image
+ * image: Output images, all the same size. Every pixel is written by exactly one tile
+ * count: Number of views & images
+ * step: Only pixels on every step-th row & column are cast, 1 for all of them
+ * skip: Pixels on every skip-th row & column were cast by an earlier pass & are left alone, 0 to skip none
+ * frustum: 1 to gather the subtrees inside each tile's frustum first, 0 to traverse the whole BVH for every pixel
+ * stats: Counts of every tile are added to it
+ */
+static void render_tiles(ThreadPool& pool, const TriTable& table, const BVH& bvh, ChunkCache* chunks, const Shading& light, const View* view,
+	Framebuffer* const* image, int count, int step, int skip, int frustum, RayStats& stats)
+{
+	int width = image[0]->width, height = image[0]->height;
+	int tile_cols = (width + TILE - 1) / TILE;
+	int tile_rows = (height + TILE - 1) / TILE;
+	int tiles = tile_rows * tile_cols;
+	std::vector<RayStats> tile_stats(tiles * count); //One per job, summed once every tile is done
+
+	pool.run(tiles * count, [&](int job) {
+		int v = job / tiles;
+		int r0 = ((job % tiles) / tile_cols) * TILE;
+		int c0 = ((job % tiles) % tile_cols) * TILE;
+		int r1 = std::min(r0 + TILE, height) - 1, c1 = std::min(c0 + TILE, width) - 1;
+
+		//Neighboring rays see the same few boxes, so find the ones inside the tile's frustum once
+		std::vector<TilePart> part;
+		Vector corner[4] = { pixel_image(view[v], r0, c0), pixel_image(view[v], r0, c1),
+			pixel_image(view[v], r1, c1), pixel_image(view[v], r1, c0) };
+		tile_parts(table, bvh, chunks, view[v].camera, corner, frustum, part);
+
+		for (int r = r0; r <= r1; r += step)
+		{
+			bool skip_row = (skip > 0 && r % skip == 0);
+			for (int c = c0; c <= c1; c += step)
+			{
+				if (skip_row && c % skip == 0) continue; //Cast by a coarser pass
+				render_pixel(part, light, view[v], r, c, *image[v], tile_stats[job]);
+			}
+		}
+	});
+	for (size_t i = 0; i < tile_stats.size(); i++) stats.add(tile_stats[i]);
+}
+
+/* Random looking but repeatable offset in [0, 1), so every run & thread count jitters the samples the same way
+ * r: Row of the pixel
+ * c: Column of the pixel
+ * k: Sample number & axis
+ */
+static float jitter(int r, int c, int k)
+{
+	//Integer hash of the three values, top 24 bits become the fraction
+	uint32_t h = (uint32_t)r * 0x9E3779B1u ^ (uint32_t)c * 0x85EBCA77u ^ (uint32_t)k * 0xC2B2AE3Du;
+	h ^= h >> 16;
+	h *= 0x7FEB352Du;
+	h ^= h >> 15;
+	h *= 0x846CA68Bu;
+	h ^= h >> 16;
+	return (h >> 8) * (1.0f / 16777216.0f);
+}
+
+/* Check if pixel r,c sits on an edge: a 4-neighbor sees another face (or background), or its depth jumps by more than AA_DEPTH
+ * image: Image with the depth & face index buffers of a full pass
+ * r: Row of the pixel
+ * c: Column of the pixel
+ * Return 1 if the pixel should be supersampled, 0 otherwise
+ */
+static int is_edge(const Framebuffer& image, int r, int c)
+{
+	static const int dr[4] = { -1, 1, 0, 0 }, dc[4] = { 0, 0, -1, 1 };
+	size_t p = (size_t)r * image.width + c;
+	for (int k = 0; k < 4; k++)
+	{
+		int nr = r + dr[k], nc = c + dc[k];
+		if (nr < 0 || nr >= image.height || nc < 0 || nc >= image.width) continue;
+		size_t q = (size_t)nr * image.width + nc;
+		if (image.id[q] != image.id[p]) return 1;
+		if (image.id[p] >= 0 && fabsf(image.depth[q] - image.depth[p]) > AA_DEPTH * std::min(image.depth[q], image.depth[p])) return 1;
+	}
+	return 0;
+}
+
+/* Supersample the edge pixels of images rendered with one ray per pixel. Each edge pixel is split into aa x aa strata,
+ * one jittered ray is cast in each, and the pixel becomes the average of their shades. Depth, face index & normal
+ * keep the value of the pixel center, since those can't be blended
+ * pool: Threads that share the tiles
+ * table: Precomputed triangles, in BVH order
+ * bvh: Hierarchy built over the faces, shared by every view
+ * chunks: Open .rchunks file, NULL to render from table & bvh
+ * light: How to shade hit pixels
+ * view: Camera & the 3D coordinates bounding each image
+ * image: Images with depth & face index buffers, from a full pass
+ * count: Number of views & images
+ * aa: Strata per side of a pixel
+ * frustum: 1 to gather the subtrees inside each tile's frustum first, 0 to traverse the whole BVH for every sample
+ * stats: Counts of every tile are added to it
+ */
+static void refine_tiles(ThreadPool& pool, const TriTable& table, const BVH& bvh, ChunkCache* chunks, const Shading& light, const View* view,
+	Framebuffer* const* image, int count, int aa, int frustum, RayStats& stats)
+{
+	int width = image[0]->width, height = image[0]->height;
+	int tile_cols = (width + TILE - 1) / TILE;
+	int tile_rows = (height + TILE - 1) / TILE;
+	int tiles = tile_rows * tile_cols;
+	std::vector<RayStats> tile_stats(tiles * count); //One per job, summed once every tile is done
+
+	pool.run(tiles * count, [&](int job) {
+		int v = job / tiles;
+		int r0 = ((job % tiles) / tile_cols) * TILE;
+		int c0 = ((job % tiles) % tile_cols) * TILE;
+		int r1 = std::min(r0 + TILE, height) - 1, c1 = std::min(c0 + TILE, width) - 1;
+		Framebuffer& out = *image[v];
+		RayStats& counts = tile_stats[job];
+
+		//Samples reach half a pixel past the outer pixel centers, so the frustum is widened to match
+		std::vector<TilePart> part;
+		Vector corner[4] = { pixel_image(view[v], r0 - 0.5f, c0 - 0.5f), pixel_image(view[v], r0 - 0.5f, c1 + 0.5f),
+			pixel_image(view[v], r1 + 0.5f, c1 + 0.5f), pixel_image(view[v], r1 + 0.5f, c0 - 0.5f) };
+		tile_parts(table, bvh, chunks, view[v].camera, corner, frustum, part);
+
+		for (int r = r0; r <= r1; r++)
+		{
+			for (int c = c0; c <= c1; c++)
+			{
+				if (!is_edge(out, r, c)) continue;
+				counts.refined++;
+
+				int sum = 0;
+				for (int k = 0; k < aa * aa; k++)
+				{
+					//One ray in each stratum, at a jittered spot inside it
+					float sr = r - 0.5f + (k / aa + jitter(r, c, 2 * k)) / aa;
+					float sc = c - 0.5f + (k % aa + jitter(r, c, 2 * k + 1)) / aa;
+					float zBuffer = FAR;
+					int close_slot = -1;
+					Vector image = pixel_image(view[v], sr, sc);
+					const TriTable* hit = trace(part, view[v].camera, image, zBuffer, close_slot, counts);
+					if (hit == NULL) continue; //Background adds BLACK
+					counts.hits++;
+					sum += shade(light, *hit, close_slot, view[v].camera, image, zBuffer, counts);
+				}
+				out.row(r)[c] = (unsigned char)((sum + aa * aa / 2) / (aa * aa)); //Edges are found from depth & index, never the shade
+			}
+		}
+	});
+	for (size_t i = 0; i < tile_stats.size(); i++) stats.add(tile_stats[i]);
+}
+
+/* Fill every pixel with the cast pixel at the top left of its step x step block, so a coarse pass looks like a whole image
+ * image: Image where every step-th pixel of every step-th row is cast
+ * step: Spacing of the cast pixels
+ */
+static void fill_nearest(Framebuffer& image, int step)
+{
+	for (int r = 0; r < image.height; r++)
+	{
+		unsigned char* row = image.row(r);
+		const unsigned char* src = image.row(r - r % step);
+		for (int c = 0; c < image.width; c++) row[c] = src[c - c % step];
+	}
+}
+
+/* Seconds passed since a start time
+ * start: Time the phase started
+ */
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/* Set up the camera & the 3D coordinates bounding the image. The longer side of the image spans more of the scene,
+ * so the whole bounding box stays in frame for any aspect ratio
+ * view: Output camera & image plane
+ * center: Center of the bounding box
+ * E: Largest extent of the bounding box
+ * X: Degrees the camera is rotated about the X axis
+ * Y: Degrees the camera is rotated about the Y axis
+ * Z: Degrees the camera is rotated about the Z axis
+ * width: Number of image columns
+ * height: Number of image rows
+ */
+template <typename T>
+void make_view(ViewT<T>& view, Vec3<T> center, T E, T X, T Y, T Z, int width, int height)
+{
+	Vec3<T> camera, up, left, right, top, bottom, top_left, diff;
+	T a;
+
+	//Extent of each image side compared to E, a square image covers E both ways
+	T span_w = (width > height) ? (T)width / height : (T)1;
+	T span_h = (height > width) ? (T)height / width : (T)1;
+
+	//Default camera onto X axis (<1,0,0>) 
+	camera = Vec3<T>(1.0, 0.0, 0.0);
+
+	//Default up onto Z axis (<0,0,1>) 
+	up = Vec3<T>(0.0, 0.0, 1.0);
+
+	//Rotate camera & up vector
+	rotate(camera, up, X, Y, Z);
+
+	//Move and scale the camera vector (<camera> = 1.5E<camera> + <center>) 
+	camera = camera * (1.5 * E); //<camera> = 1.5E*<camera> 
+	camera = camera + center; //<camera> = 1.5e*<camera> + center 
+
+	/* Determine the 3D coordinates bounding the image */
+
+	//Find first left
+	diff = center - camera;//<diff> = <center> - <camera> 
+	left = up.cross(diff); //<left> = <up> x <center-camera> 
+
+	//Find a = ||<left>||
+	a = std::sqrt((left.a * left.a) + (left.b * left.b) + (left.c * left.c));
+
+	//Find final left
+	left = left * (E * span_w / (2 * a)); //<left> = E/2a<left> 
+	left = left + center;//<left> = E/2a<left> + center  
+
+	//Find right
+	right = diff.cross(up); //right = <center-camera> x <up> 
+	right = right * (E * span_w / (2 * a)); //<right> = E/2a<right> 
+	right = right + center;//<right> = E/2a<right> + center 
+
+	//Find top 
+	top = up * (E * span_h / 2); //<top> = E/2<up> 
+	top = top + center;//<top> = E/2<up> + <center> 
+
+	//Find bottom 
+	bottom = up * ((-E * span_h) / 2); //<bottom> = -E/2<up> 
+	bottom = bottom + center;//<bottom> = -E/2<up> + <center> 
+
+	//Find topleft 
+	top_left = up * (E * span_h / 2); //<topleft> = E/2<up> 
+	top_left = top_left + left;//<topleft> = E/2<up> + <left> 
+
+	view.camera = camera;
+	view.left = left;
+	view.right = right;
+	view.top = top;
+	view.bottom = bottom;
+	view.top_left = top_left;
+	view.col_span = (width > 1) ? width - 1 : 1; //A 1 pixel wide image just uses the left edge
+	view.row_span = (height > 1) ? height - 1 : 1;
+}
+
+//Float for the default setup, double for --precision local & double. bvh.cpp uses find_e too
+template float find_e<float>(Vector max, Vector min);
+template double find_e<double>(DVector max, DVector min);
+template void make_view<float>(View& view, Vector center, float E, float X, float Y, float Z, int width, int height);
+template void make_view<double>(ViewT<double>& view, DVector center, double E, double X, double Y, double Z, int width, int height);
+
+/* Write the image as a binary greyscale .ppm (P5) to an open stream
+ * out: Stream to write to, opened in binary mode
+ * image: Pixels to write
+ * Return 1 on success, 0 if the stream failed
+ */
+int write_ppm(std::ostream& out, const Framebuffer& image)
+{
+	std::string newHeader = "P5 " + std::to_string(image.width) + " " + std::to_string(image.height) + " 255\n";
+	out.write(newHeader.c_str(), newHeader.size());
+	for (int r = 0; r < image.height; r++) out.write(reinterpret_cast<const char*>(image.row(r)), image.width); //Expects char, need to convert from unsigned to char
+	return out.good();
+}
+
+/* Write the image to a binary greyscale .ppm file (P5)
+ * filename: Name of the new file
+ * image: Pixels to write
+ * Return 1 on success, 0 if the file couldn't be written
+ */
+int write_ppm(const std::string& filename, const Framebuffer& image)
+{
+	std::ofstream outfile(filename, std::ios::binary);
+	if (!outfile.is_open()) return 0;
+
+	if (!write_ppm(outfile, image)) return 0;
+	outfile.close();
+	return outfile.good();
+}
+
+/* Write the depth buffer as a little endian .pfm (Pf). PFM stores the bottom row first
+ * filename: Name of the new file
+ * image: Image with a depth buffer
+ * Return 1 on success, 0 if the file couldn't be written
+ */
+static int write_pfm(const std::string& filename, const Framebuffer& image)
+{
+	std::ofstream outfile(filename, std::ios::binary);
+	if (!outfile.is_open()) return 0;
+
+	//Negative scale marks little endian floats, flip the bytes on a big endian machine
+	std::string header = "Pf\n" + std::to_string(image.width) + " " + std::to_string(image.height) + "\n-1.0\n";
+	outfile.write(header.c_str(), header.size());
+	std::vector<char> row((size_t)image.width * 4);
+	for (int r = image.height - 1; r >= 0; r--)
+	{
+		for (int c = 0; c < image.width; c++)
+		{
+			uint32_t bits;
+			memcpy(&bits, &image.depth[(size_t)r * image.width + c], 4);
+			for (int k = 0; k < 4; k++) row[4 * c + k] = (char)(bits >> (8 * k));
+		}
+		outfile.write(row.data(), row.size());
+	}
+	outfile.close();
+	return outfile.good();
+}
+
+/* Write the face index buffer as a .tid file: a "TI\n<width> <height>\n" header, then one little endian
+ * 32 bit signed face index per pixel, top row first, -1 for background
+ * filename: Name of the new file
+ * image: Image with a face index buffer
+ * Return 1 on success, 0 if the file couldn't be written
+ */
+static int write_tid(const std::string& filename, const Framebuffer& image)
+{
+	std::ofstream outfile(filename, std::ios::binary);
+	if (!outfile.is_open()) return 0;
+
+	std::string header = "TI\n" + std::to_string(image.width) + " " + std::to_string(image.height) + "\n";
+	outfile.write(header.c_str(), header.size());
+	std::vector<char> row((size_t)image.width * 4);
+	for (int r = 0; r < image.height; r++)
+	{
+		for (int c = 0; c < image.width; c++)
+		{
+			uint32_t bits = (uint32_t)image.id[(size_t)r * image.width + c];
+			for (int k = 0; k < 4; k++) row[4 * c + k] = (char)(bits >> (8 * k));
+		}
+		outfile.write(row.data(), row.size());
+	}
+	outfile.close();
+	return outfile.good();
+}
+
+/* Write the normal buffer as a binary color .ppm file (P6)
+ * filename: Name of the new file
+ * image: Image with a normal buffer
+ * Return 1 on success, 0 if the file couldn't be written
+ */
+static int write_normal_ppm(const std::string& filename, const Framebuffer& image)
+{
+	std::ofstream outfile(filename, std::ios::binary);
+	if (!outfile.is_open()) return 0;
+
+	std::string header = "P6 " + std::to_string(image.width) + " " + std::to_string(image.height) + " 255\n";
+	outfile.write(header.c_str(), header.size());
+	outfile.write(reinterpret_cast<const char*>(image.normal), (size_t)image.width * image.height * 3);
+	outfile.close();
+	return outfile.good();
+}
+
+/* Write every extra buffer the image has: base.pfm for depth, base.tid for face indices & base_normal.ppm for normals
+ * base: Filename without extension
+ * image: Image whose buffers are written, missing buffers are skipped
+ * Return 1 on success, 0 if a file couldn't be written
+ */
+int write_aux(const std::string& base, const Framebuffer& image)
+{
+	if (image.depth != NULL && !write_pfm(base + ".pfm", image)) return 0;
+	if (image.id != NULL && !write_tid(base + ".tid", image)) return 0;
+	if (image.normal != NULL && !write_normal_ppm(base + "_normal.ppm", image)) return 0;
+	return 1;
+}
+
+/* Make sure every choice is in range & works with the chosen engine, so front-ends can't hand the Engine
+ * something it would silently ignore or turn into NaNs
+ * error: Output reason the options can't be used
+ * Return 1 if they can, 0 otherwise
+ */
+int EngineOptions::check(std::string& error) const
+{
+	float length = v_dot_product(light, light);
+	if (threads < 0) error = "Threads must be 0 (every core) or more";
+	else if (kernel < KERNEL_AUTO || kernel > KERNEL_DOUBLE) error = "Unknown kernel";
+	else if (precision != PRECISION_FLOAT && precision != PRECISION_LOCAL && precision != PRECISION_DOUBLE) error = "Unknown precision";
+	else if (aa < 1 || aa > AA_MAX) error = "Supersampling must be 1 to " + std::to_string(AA_MAX) + " rays per side";
+	else if (std::isnan(weld_eps)) error = "Weld distance must be a number";
+	else if (chunk_faces < 1) error = "Chunks must hold at least 1 face";
+	else if (cache < 1) error = "Chunk cache must be at least 1 megabyte";
+	else if (shade != SHADE_INDEX && shade != SHADE_LAMBERT) error = "Unknown shading";
+	else if (!std::isfinite(length) || length == 0) error = "Light direction must be finite & not 0";
+	else if (shadows && shade != SHADE_LAMBERT) error = "Shadows need lambert shading";
+	else if (raster && (aa > 1 || progressive || out_of_core || shade != SHADE_INDEX))
+		error = "Supersampling, progressive passes, out of core rendering & lambert shading need the ray engine";
+	else return 1;
+	return 0;
+}
+
+/* Read a .ply or .rscene file, clean it if asked, then build the BVH & triangle table the ray caster needs.
+ * An .rscene file with a BVH is used in place, nothing is parsed, built or copied. An .rchunks file is opened for
+ * rendering out of core, only its chunk boxes are read
+ * filename: Model to load, .rscene & .rchunks files are picked by their extension
+ * error: Output message when the options can't be used or the file can't be read
+ * Return 1 on success, 0 otherwise
+ */
+int Engine::load(const std::string& filename, std::string& error)
+{
+	if (!options.check(error)) return 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	SceneInfo scene;
+	if (filename.size() > 8 && filename.compare(filename.size() - 8, 8, ".rchunks") == 0)
+	{
+		if (options.raster || options.clean)
+		{
+			error = "An .rchunks file is rendered by the ray engine as it is, it can't be rasterized or cleaned";
+			return 0;
+		}
+		return open_chunks(filename, error);
+	}
+	if (filename.size() > 7 && filename.compare(filename.size() - 7, 7, ".rscene") == 0)
+	{
+		if (!load_scene(filename, scene_file, scene, bvh, table, error)) return 0;
+		prepared = scene.has_bvh && !options.raster && !options.clean && !options.out_of_core;
+		if (!prepared) scene_mesh(scene_file, V, triangle, source);
+	}
+	else if (options.precision != PRECISION_FLOAT)
+	{
+		//Vertices stay in double until they are moved next to the center of the model, then each is rounded once
+		std::vector<DVector> wide;
+		if (!load_ply(filename, wide, triangle, error)) return 0;
+		origin = v_center(v_max(wide, (int)wide.size()), v_min(wide, (int)wide.size()));
+		V.resize(wide.size());
+		for (size_t i = 0; i < V.size(); i++) V[i] = Vector(wide[i] - origin);
+	}
+	else if (!load_ply(filename, V, triangle, error)) return 0;
+	if (source.size() != triangle.size())
+	{
+		source.resize(triangle.size());
+		for (size_t i = 0; i < source.size(); i++) source[i] = (int)i;
+	}
+	times.parse = seconds_since(start);
+
+	/* Weld & compact the mesh. Faces keep their .ply index in source, so shading doesn't change */
+	if (options.clean)
+	{
+		start = std::chrono::steady_clock::now();
+		float eps = options.weld_eps;
+		if (eps < 0) eps = WELD_EPS * find_e(v_max(V, (int)V.size()), v_min(V, (int)V.size()));
+		clean_mesh(V, triangle, source, eps, report);
+		times.clean = seconds_since(start);
+	}
+	vertices = prepared ? scene.vertices : (int)V.size();
+	faces = prepared ? scene.faces : (int)triangle.size();
+
+	/* Build the bounding volume hierarchy & the triangle table once, every pixel ray reuses them. Rasterizer needs neither,
+	 * and out of core each chunk gets its own */
+	if (!options.raster && !options.out_of_core)
+	{
+		if (!prepared)
+		{
+			start = std::chrono::steady_clock::now();
+			bvh.build(V, triangle);
+			times.bvh = seconds_since(start);
+
+			start = std::chrono::steady_clock::now();
+			table.build(V, triangle, bvh.index, source);
+			times.table = seconds_since(start);
+		}
+		kernel = table.set_kernel((options.precision == PRECISION_DOUBLE) ? KERNEL_DOUBLE : options.kernel);
+		table.cull = options.cull;
+	}
+
+	/* Calculate the bounding box on the vertices, an .rscene file already knows it */
+	if (prepared)
+	{
+		max = scene.max;
+		min = scene.min;
+	}
+	else
+	{
+		max = v_max(V, vertices); 
+		min = v_min(V, vertices); 
+	}
+	center = v_center(max, min); 
+	E = find_e(max, min); 
+	return 1;
+}
+
+/* Export the loaded model, so the next run can skip parsing & setup. The BVH & table are left out for the rasterizer
+ * filename: Name of the new .rscene file
+ * error: Output reason the file couldn't be written
+ * Return 1 on success, 0 otherwise
+ */
+int Engine::save(const std::string& filename, std::string& error)
+{
+	if (chunks.is_open())
+	{
+		error = "An .rchunks file holds no mesh to save";
+		return 0;
+	}
+	if (prepared && V.empty()) scene_mesh(scene_file, V, triangle, source);
+	bool with_bvh = !options.raster && !bvh.nodes.empty();
+	return save_scene(filename, V, triangle, source, with_bvh ? &bvh : NULL, with_bvh ? &table : NULL, min, max, error);
+}
+
+/* Split the loaded model into spatial chunks, each with its own BVH & table, and write them to an .rchunks file.
+ * The mesh is freed afterwards & every later view renders out of core from the file
+ * filename: Name of the new .rchunks file
+ * error: Output reason the file couldn't be written or opened
+ * Return 1 on success, 0 otherwise
+ */
+int Engine::save_chunks(const std::string& filename, std::string& error)
+{
+	if (chunks.is_open())
+	{
+		error = "Model is already in an .rchunks file";
+		return 0;
+	}
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (prepared && V.empty()) scene_mesh(scene_file, V, triangle, source);
+	if (!::save_chunks(filename, V, triangle, source, options.chunk_faces, min, max, origin, error)) return 0;
+	times.bvh += seconds_since(start);
+
+	//Only the chunk boxes stay in memory from here on
+	std::vector<Vector>().swap(V);
+	std::vector<Face>().swap(triangle);
+	std::vector<int>().swap(source);
+	bvh.nodes.release();
+	bvh.index.release();
+	table.count = 0;
+	table.id.release();
+	for (int k = 0; k < 3; k++)
+	{
+		table.v0[k].release();
+		table.v1[k].release();
+		table.v2[k].release();
+	}
+	scene_file.close();
+	prepared = false;
+	return open_chunks(filename, error);
+}
+
+/* Open an .rchunks file for rendering out of core, every chunk read later uses the kernel picked here
+ * filename: .rchunks file to open
+ * error: Output reason the file couldn't be opened
+ * Return 1 on success, 0 otherwise
+ */
+int Engine::open_chunks(const std::string& filename, std::string& error)
+{
+	if (!chunks.open(filename, (size_t)std::max(options.cache, 0) << 20, error)) return 0;
+	TriTable probe;
+	kernel = probe.set_kernel((options.precision == PRECISION_DOUBLE) ? KERNEL_DOUBLE : options.kernel);
+	chunks.kernel = kernel;
+	chunks.cull = options.cull;
+	vertices = chunks.vertices;
+	faces = chunks.faces;
+	max = chunks.max;
+	min = chunks.min;
+	origin = chunks.origin;
+	center = v_center(max, min);
+	E = find_e(max, min);
+	return 1;
+}
+
+/* Set up the camera & image plane of one view of the loaded model
+ * view: Output camera & image plane
+ * X: Degrees the camera is rotated about the X axis
+ * Y: Degrees the camera is rotated about the Y axis
+ * Z: Degrees the camera is rotated about the Z axis
+ * width: Number of image columns
+ * height: Number of image rows
+ */
+void Engine::view(View& view, float X, float Y, float Z, int width, int height) const
+{
+	if (options.precision == PRECISION_FLOAT)
+	{
+		make_view(view, center, E, X, Y, Z, width, height);
+		return;
+	}
+
+	//Camera & image plane in double from the float bounding box, rounded once at the end
+	ViewT<double> wide;
+	make_view(wide, v_center(DVector(max), DVector(min)), find_e(DVector(max), DVector(min)), (double)X, (double)Y, (double)Z,
+		width, height);
+	view = View(wide);
+}
+
+/* Render one or more views of the loaded model, side by side on the thread pool
+ * view: Camera & the 3D coordinates bounding each image
+ * image: Output images, all the same size
+ * count: Number of views & images
+ * step: Only pixels on every step-th row & column are cast, the rest are filled from them. 1 for all of them (ray caster only).
+ *       Edge pixels are supersampled once step is 1, when options.aa is above 1
+ * skip: Pixels on every skip-th row & column were cast by an earlier pass & are left alone, 0 to skip none (ray caster only)
+ */
+void Engine::render(const View* view, Framebuffer* const* image, int count, int step, int skip)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (options.raster)
+	{
+		for (int g = 0; g < count; g++) raster_render(pool, V, triangle, source, view[g], options.cull, *image[g]);
+	}
+	else
+	{
+		//Supersampling finds edges from the face index & depth of every pixel, so the first pass adds those buffers if needed
+		bool aa = (options.aa > 1);
+		if (aa && skip == 0)
+		{
+			scratch_depth = (image[0]->depth == NULL);
+			scratch_id = (image[0]->id == NULL);
+			for (int g = 0; g < count; g++) image[g]->add_aux(1, 1, 0);
+		}
+
+		ChunkCache* out_of_core = chunks.is_open() ? &chunks : NULL;
+		Shading light;
+		light.shade = options.shade;
+		light.shadows = options.shadows;
+		light.light = options.light * (1.0f / sqrtf(v_dot_product(options.light, options.light)));
+		light.reach = std::max(E, 1e-20f);
+		light.bvh = &bvh;
+		light.table = &table;
+		light.chunks = out_of_core;
+		render_tiles(pool, table, bvh, out_of_core, light, view, image, count, step, skip, options.frustum, counts);
+		if (step > 1) for (int g = 0; g < count; g++) fill_nearest(*image[g], step);
+
+		//Only the full image is refined, then the buffers nobody asked for are freed
+		if (aa && step == 1)
+		{
+			refine_tiles(pool, table, bvh, out_of_core, light, view, image, count, options.aa, options.frustum, counts);
+			for (int g = 0; g < count; g++) image[g]->drop_aux(scratch_depth, scratch_id, 0);
+		}
+	}
+	times.render += seconds_since(start);
+}
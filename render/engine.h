@@ -0,0 +1,107 @@
+/* engine.h
+ * Render Engine Library
+ *
+ * Purpose: To hold the whole pipeline behind one class: parse (or map) the model, clean it, build the BVH & triangle
+ *          table, place the camera and render views with the ray caster or the rasterizer. render2.cpp drives it
+ *          from C++, and librender.cpp wraps it in the C interface of render.h that render.c uses.
+ *          An .rchunks file is rendered out of core, only the chunks each tile can see are read into memory
+ *
+ * Assumptions: User loads one model per Engine, then renders as many views of it as they like.
+ *              Images passed to render() are all the same size
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include "render2.h"
+#include "bvh.h"
+#include "tri_table.h"
+#include "mesh.h"
+#include "scene.h"
+#include "mapped_file.h"
+#include "chunk.h"
+#include "thread_pool.h"
+
+/* Declare Classes */
+
+//Class holds the choices both front-ends share, set before the model is loaded
+class EngineOptions {
+public:
+	int threads; //Threads that render tiles, 0 for every core
+	int kernel; //KERNEL_AUTO, KERNEL_SCALAR, KERNEL_SSE, KERNEL_AVX2 or KERNEL_DOUBLE
+	int raster; //1 for the z-buffer rasterizer, 0 for the ray caster
+	int cull; //1 to skip triangles facing away from the camera
+	int frustum; //1 to cull each tile's BVH subtrees against its frustum before casting
+	int clean; //1 to weld vertices & drop degenerate faces before building anything
+	float weld_eps; //Weld distance of clean, below 0 picks one from the model size
+	int precision; //PRECISION_FLOAT, PRECISION_LOCAL or PRECISION_DOUBLE
+	int aa; //Strata per side of each edge pixel, 1 for one ray per pixel (ray caster only)
+	int out_of_core; //1 to skip the BVH & table of the whole model, it is rendered from save_chunks()'s file instead
+	int chunk_faces; //Most faces in one chunk written by save_chunks()
+	int cache; //Megabytes of chunks held in memory when rendering out of core
+	int shade; //SHADE_INDEX or SHADE_LAMBERT (ray caster only)
+	int shadows; //1 to cast a shadow ray from every lit hit, SHADE_LAMBERT only
+	Vector light; //Direction towards the light in model coordinates, any length but 0
+	int progressive; //1 if views are rendered in coarse passes first, render() with step above 1 (ray caster only)
+
+	EngineOptions() : threads(0), kernel(KERNEL_AUTO), raster(0), cull(0), frustum(1), clean(0), weld_eps(-1),
+		precision(PRECISION_FLOAT), aa(1), out_of_core(0), chunk_faces(CHUNK_FACES), cache(CHUNK_CACHE), shade(SHADE_INDEX),
+		shadows(0), light(1, 1, 1), progressive(0) {}
+
+	/* Member Functions Declarations */
+	int check(std::string& error) const; //Return 1 if every choice is in range & works with the chosen engine
+};
+
+//Class holds the seconds spent in each phase
+class EngineTimes {
+public:
+	double parse, clean, bvh, table, render;
+
+	EngineTimes() : parse(0), clean(0), bvh(0), table(0), render(0) {}
+};
+
+//Class holds a loaded model & everything built on it
+class Engine {
+public:
+	EngineOptions options; //What the engine was asked to do
+	ThreadPool pool; //Threads shared by every render() call
+	std::vector<Vector> V; //Vertices, relative to origin. Empty for an .rscene file that is used in place
+	std::vector<Face> triangle; //Faces
+	std::vector<int> source; //Index in the .ply file of every face
+	BVH bvh; //Hierarchy over the faces, ray caster only
+	TriTable table; //Corners of every face in BVH order, ray caster only
+	ChunkCache chunks; //Chunks of an .rchunks file, open when rendering out of core. The BVH & table are empty then
+	int kernel; //Kernel table uses, after set_kernel() picked what the CPU can run
+	int vertices, faces; //Size of the model after cleaning
+	Vector min, max, center; //Bounding box of the vertices
+	float E; //Largest extent of the bounding box
+	DVector origin; //Subtracted from every vertex by PRECISION_LOCAL & PRECISION_DOUBLE, so floats keep their precision
+	MeshReport report; //What cleaning removed, when options.clean is set
+	EngineTimes times; //Seconds spent in each phase
+	RayStats counts; //Rays, boxes & triangle tests of every render() call
+
+	/* Constructors */
+	Engine(const EngineOptions& opt) : options(opt), pool(opt.threads), kernel(KERNEL_SCALAR), vertices(0), faces(0), E(0),
+		prepared(false), scratch_depth(0), scratch_id(0) {}
+	Engine(const Engine&) = delete; //Tables may borrow the mapped file, no copies
+	Engine& operator=(const Engine&) = delete;
+
+	/* Member Functions Declarations */
+	int load(const std::string& filename, std::string& error); //Read a .ply or .rscene file & build everything, return 1 on success
+	int save(const std::string& filename, std::string& error); //Write the model & its BVH to an .rscene file, return 1 on success
+	int save_chunks(const std::string& filename, std::string& error); //Write the model to an .rchunks file & render from it, return 1 on success
+	void view(View& view, float X, float Y, float Z, int width, int height) const; //Camera rotated by X, Y, Z degrees
+	void render(const View* view, Framebuffer* const* image, int count, int step = 1, int skip = 0); //Render views side by side
+
+private:
+	MappedFile scene_file; //.rscene file the BVH & table borrow from
+	bool prepared; //BVH & table came from the .rscene file, V & triangle are only copied out when save() needs them
+	int scratch_depth, scratch_id; //Buffers render() added to the images for supersampling, freed after the last pass
+
+	int open_chunks(const std::string& filename, std::string& error); //Render from an .rchunks file from now on, return 1 on success
+};
+
+/* Function Declarations */
+double seconds_since(std::chrono::steady_clock::time_point start); //Seconds passed since a start time
@@ -0,0 +1,157 @@
+/* librender.cpp
+ * C Interface of the Render Engine
+ *
+ * Purpose: To implement render.h for C front-ends. Each call is a thin wrapper around the Engine class,
+ *          so both front-ends load, prepare & render a model the same way
+ *
+ * Assumptions: No C++ exception may cross into C, so every entry point catches them & reports failure instead
+ */
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <exception>
+#include "render2.h"
+#include "tri_table.h"
+#include "engine.h"
+#include "render.h"
+
+static_assert(KERNEL_AUTO == -1 && KERNEL_SCALAR == 0 && KERNEL_SSE == 1 && KERNEL_AVX2 == 2 && KERNEL_DOUBLE == 3,
+	"render_options.kernel uses the kernel numbers of tri_table.h");
+static_assert(PRECISION_FLOAT == 0 && PRECISION_LOCAL == 1 && PRECISION_DOUBLE == 2,
+	"render_options.precision uses the precision numbers of render2.h");
+static_assert(SHADE_INDEX == RENDER_SHADE_INDEX && SHADE_LAMBERT == RENDER_SHADE_LAMBERT,
+	"render_options.shade uses the shading numbers of render2.h");
+
+//Structure holds the Engine behind a C handle
+struct render_scene {
+	Engine engine;
+
+	render_scene(const EngineOptions& options) : engine(options) {}
+};
+
+/* Copy a message into the caller's error buffer, cut to fit
+ * error: Output buffer, may be NULL
+ * error_size: Size of the buffer in bytes
+ * message: Text to copy
+ */
+static void copy_error(char* error, int error_size, const std::string& message)
+{
+	if (error == NULL || error_size < 1) return;
+	size_t n = std::min(message.size(), (size_t)error_size - 1);
+	memcpy(error, message.c_str(), n);
+	error[n] = '\0';
+}
+
+/* Fill the options with the same defaults render2 uses
+ * options: Output options
+ */
+void render_default_options(render_options* options)
+{
+	EngineOptions defaults;
+	options->threads = defaults.threads;
+	options->kernel = defaults.kernel;
+	options->engine = defaults.raster ? RENDER_RASTER : RENDER_RAY;
+	options->cull = defaults.cull;
+	options->frustum = defaults.frustum;
+	options->clean = defaults.clean;
+	options->weld_eps = defaults.weld_eps;
+	options->precision = defaults.precision;
+	options->aa = defaults.aa;
+	options->cache = defaults.cache;
+	options->shade = defaults.shade;
+	options->shadows = defaults.shadows;
+	options->light[0] = defaults.light.a;
+	options->light[1] = defaults.light.b;
+	options->light[2] = defaults.light.c;
+}
+
+/* Load a model & build everything the chosen engine needs
+ * filename: .ply file, an .rscene file saved by render2 --save-scene or an .rchunks file saved by --save-chunks
+ * options: Choices from render_default_options(), NULL for the defaults
+ * error: Output reason the model couldn't be loaded, may be NULL
+ * error_size: Size of the error buffer in bytes
+ * Return the new scene, NULL on failure
+ */
+render_scene* render_open(const char* filename, const render_options* options, char* error, int error_size)
+{
+	try
+	{
+		EngineOptions opt;
+		if (options != NULL)
+		{
+			opt.threads = options->threads;
+			opt.kernel = options->kernel;
+			opt.raster = (options->engine == RENDER_RASTER);
+			opt.cull = options->cull;
+			opt.frustum = options->frustum;
+			opt.clean = options->clean;
+			opt.weld_eps = options->weld_eps;
+			opt.precision = options->precision;
+			opt.aa = options->aa;
+			opt.cache = options->cache;
+			opt.shade = options->shade;
+			opt.shadows = options->shadows;
+			opt.light = Vector(options->light[0], options->light[1], options->light[2]);
+		}
+
+		std::string message;
+		if (!opt.check(message))
+		{
+			copy_error(error, error_size, message);
+			return NULL;
+		}
+
+		std::unique_ptr<render_scene> scene(new render_scene(opt));
+		if (!scene->engine.load(filename, message))
+		{
+			copy_error(error, error_size, message);
+			return NULL;
+		}
+		return scene.release();
+	}
+	catch (const std::exception& e)
+	{
+		copy_error(error, error_size, e.what());
+		return NULL;
+	}
+}
+
+/* Render one view of a loaded scene
+ * scene: Scene from render_open()
+ * X: Degrees the camera is rotated about the X axis
+ * Y: Degrees the camera is rotated about the Y axis
+ * Z: Degrees the camera is rotated about the Z axis
+ * width: Number of image columns
+ * height: Number of image rows
+ * pixel: Output width * height greyscale values, row by row
+ * Return 1 on success, 0 otherwise
+ */
+int render_view(render_scene* scene, float X, float Y, float Z, int width, int height, unsigned char* pixel)
+{
+	if (scene == NULL || pixel == NULL || width < 1 || height < 1) return 0;
+	try
+	{
+		Framebuffer image(width, height);
+		Framebuffer* image_ptr = &image;
+		View view;
+		scene->engine.view(view, X, Y, Z, width, height);
+		scene->engine.render(&view, &image_ptr, 1);
+		memcpy(pixel, image.pixel, (size_t)width * height); //Rows are stored one after another, same as the caller's buffer
+		return 1;
+	}
+	catch (const std::exception&)
+	{
+		return 0;
+	}
+}
+
+/* Free a scene & everything built on it
+ * scene: Scene from render_open(), NULL is ignored
+ */
+void render_close(render_scene* scene)
+{
+	delete scene;
+}
@@ -0,0 +1,62 @@
+/* mapped_file.cpp
+ * Memory Mapped File
+ *
+ * Purpose: To map a file into memory read only, so parsers can walk it like one big array
+ *
+ * Assumptions: POSIX system (open, fstat, mmap)
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "mapped_file.h"
+
+/* Map the whole file into memory
+ * filename: File to open
+ * sequential: 1 if the file is read front to back (parsers), 0 if it is read in place in any order (.rscene)
+ * Return 1 on success, 0 if the file couldn't be opened or mapped
+ */
+int MappedFile::open(const std::string& filename, int sequential)
+{
+	close();
+
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0) return 0;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0)
+	{
+		::close(fd);
+		return 0;
+	}
+
+	//Empty file, nothing to map but still a valid open
+	size = (size_t)info.st_size;
+	if (size == 0)
+	{
+		::close(fd);
+		data = "";
+		return 1;
+	}
+
+	void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); //Mapping stays valid after the descriptor is closed
+	if (map == MAP_FAILED)
+	{
+		size = 0;
+		return 0;
+	}
+
+	madvise(map, size, sequential ? MADV_SEQUENTIAL : MADV_NORMAL); //Parsers read front to back, let the OS read ahead
+	data = (const char*)map;
+	return 1;
+}
+
+/* Unmap the file, safe to call more than once */
+void MappedFile::close()
+{
+	if (data != NULL && size > 0) munmap((void*)data, size);
+	data = NULL;
+	size = 0;
+}
@@ -0,0 +1,32 @@
+/* mapped_file.h
+ * Memory Mapped File Library
+ *
+ * Purpose: To read a whole file without copying it. The file is mapped into memory read only,
+ *          and pages are only loaded by the OS when the parser touches them
+ *
+ * Assumptions: POSIX system (mmap). File is not changed by anyone else while it is mapped
+ */
+
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+/* Declare Classes */
+
+//Class holds one read only mapping of a file, unmapped when the object goes away
+class MappedFile {
+public:
+	const char* data; //First byte of the file, NULL if nothing is open
+	size_t size; //Number of bytes in the file
+
+	/* Constructors */
+	MappedFile() : data(NULL), size(0) {}
+	~MappedFile() { close(); }
+	MappedFile(const MappedFile&) = delete; //Owns the mapping, no copies
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/* Member Functions Declarations */
+	int open(const std::string& filename, int sequential = 1); //Map the file, return 1 on success
+	void close(); //Unmap the file
+};
@@ -0,0 +1,182 @@
+/* mesh.cpp
+ * Mesh Cleanup
+ *
+ * Purpose: To weld duplicate vertices, drop degenerate faces & unused vertices, and sort what is left by Morton order
+ *
+ * Assumptions: Welding is greedy, each vertex joins the first earlier vertex within epsilon, found through a hash grid
+ *              of eps sized cells. An epsilon of 0 only welds vertices with exactly the same coordinates
+ */
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+#include "render2.h"
+#include "mesh.h"
+
+#define MORTON_BITS 10 //Bits per axis of the sort key, 30 bits in all
+
+/* Pack three grid cell coordinates into one hash key, 21 bits each */
+static uint64_t cell_key(int64_t x, int64_t y, int64_t z)
+{
+	const uint64_t mask = (1u << 21) - 1;
+	return ((uint64_t)x & mask) | (((uint64_t)y & mask) << 21) | (((uint64_t)z & mask) << 42);
+}
+
+/* Spread the low 10 bits of x so there are two zero bits between each of them */
+static uint32_t spread_bits(uint32_t x)
+{
+	x &= 0x3ff;
+	x = (x | (x << 16)) & 0x030000ff;
+	x = (x | (x << 8)) & 0x0300f00f;
+	x = (x | (x << 4)) & 0x030c30c3;
+	x = (x | (x << 2)) & 0x09249249;
+	return x;
+}
+
+/* Weld every vertex to the first earlier vertex within eps of it
+ * V: Table that stores all vertices from .ply file
+ * eps: Largest distance between welded vertices
+ * remap: Output vertex each vertex was welded to, itself if it was kept
+ * Return number of welded vertices
+ */
+static int weld(const std::vector<Vector>& V, float eps, std::vector<int>& remap)
+{
+	int vertices = (int)V.size();
+	int welded = 0;
+	float cell = (eps > 0) ? eps : 1.0f; //Exact welding still hashes on a grid, only the distance test changes
+	std::unordered_map<uint64_t, int> head; //First kept vertex in each cell
+	std::vector<int> next(vertices, -1); //Next kept vertex in the same cell
+	head.reserve(vertices);
+	remap.resize(vertices);
+
+	for (int i = 0; i < vertices; i++)
+	{
+		const Vector& p = V[i];
+		int64_t x = (int64_t)floorf(p.a / cell), y = (int64_t)floorf(p.b / cell), z = (int64_t)floorf(p.c / cell);
+		int found = -1;
+
+		//A vertex within eps is in this cell or one of its 26 neighbors
+		for (int dz = -1; dz <= 1 && found < 0; dz++)
+		{
+			for (int dy = -1; dy <= 1 && found < 0; dy++)
+			{
+				for (int dx = -1; dx <= 1 && found < 0; dx++)
+				{
+					std::unordered_map<uint64_t, int>::const_iterator it = head.find(cell_key(x + dx, y + dy, z + dz));
+					for (int k = (it == head.end()) ? -1 : it->second; k >= 0; k = next[k])
+					{
+						Vector d = V[k] - p;
+						if (d.a * d.a + d.b * d.b + d.c * d.c <= eps * eps)
+						{
+							found = k;
+							break;
+						}
+					}
+				}
+			}
+		}
+
+		if (found >= 0)
+		{
+			remap[i] = found;
+			welded++;
+			continue;
+		}
+
+		//Keep the vertex, push it on the front of its cell's list
+		int& first = head.emplace(cell_key(x, y, z), -1).first->second;
+		next[i] = first;
+		first = i;
+		remap[i] = i;
+	}
+	return welded;
+}
+
+/* Weld vertices within eps, drop faces with a repeated corner or zero area, drop vertices no face uses,
+ * then sort faces by the Morton code of their centroid & number vertices in the order the sorted faces use them
+ * V: Table that stores all vertices from .ply file, replaced by the cleaned vertices
+ * triangle: Table that stores all faces from .ply file, replaced by the cleaned faces
+ * source: Output index in the .ply file of every cleaned face
+ * eps: Largest distance between welded vertices, 0 for exact duplicates only
+ * report: Output counts of what was removed
+ */
+void clean_mesh(std::vector<Vector>& V, std::vector<Face>& triangle, std::vector<int>& source, float eps, MeshReport& report)
+{
+	int vertices = (int)V.size();
+	int faces = (int)triangle.size();
+	std::vector<int> remap;
+
+	report = MeshReport();
+	report.vertices = vertices;
+	report.faces = faces;
+	report.welded = weld(V, eps, remap);
+
+	//Point faces at the welded vertices, keep the ones that still have an area
+	std::vector<Face> kept;
+	source.clear();
+	kept.reserve(faces);
+	source.reserve(faces);
+	for (int i = 0; i < faces; i++)
+	{
+		Face tri(remap[triangle[i].v0], remap[triangle[i].v1], remap[triangle[i].v2]);
+		Vector N = (V[tri.v1] - V[tri.v0]).cross(V[tri.v2] - V[tri.v0]);
+		if (tri.v0 == tri.v1 || tri.v1 == tri.v2 || tri.v2 == tri.v0 || (N.a == 0 && N.b == 0 && N.c == 0))
+		{
+			report.degenerate++;
+			continue;
+		}
+		kept.push_back(tri);
+		source.push_back(i);
+	}
+
+	//Sort faces along a Z curve through the bounding box of the centroids
+	int count = (int)kept.size();
+	std::vector<Vector> centroid(count);
+	Vector lo(FLOAT_MAX, FLOAT_MAX, FLOAT_MAX), hi(-FLOAT_MAX, -FLOAT_MAX, -FLOAT_MAX);
+	for (int i = 0; i < count; i++)
+	{
+		centroid[i] = (V[kept[i].v0] + V[kept[i].v1] + V[kept[i].v2]) * (1.0f / 3.0f);
+		lo = Vector(std::min(lo.a, centroid[i].a), std::min(lo.b, centroid[i].b), std::min(lo.c, centroid[i].c));
+		hi = Vector(std::max(hi.a, centroid[i].a), std::max(hi.b, centroid[i].b), std::max(hi.c, centroid[i].c));
+	}
+	float scale = (float)((1 << MORTON_BITS) - 1) / std::max(std::max(hi.a - lo.a, hi.b - lo.b), std::max(hi.c - lo.c, 1e-30f));
+	std::vector<std::pair<uint32_t, int>> key(count);
+	for (int i = 0; i < count; i++)
+	{
+		Vector q = (centroid[i] - lo) * scale;
+		key[i].first = spread_bits((uint32_t)q.a) | (spread_bits((uint32_t)q.b) << 1) | (spread_bits((uint32_t)q.c) << 2);
+		key[i].second = i;
+	}
+	std::stable_sort(key.begin(), key.end(),
+		[](const std::pair<uint32_t, int>& x, const std::pair<uint32_t, int>& y) { return x.first < y.first; });
+
+	//Number vertices in the order the sorted faces first use them, vertices never used are dropped
+	std::vector<int> number(vertices, -1);
+	std::vector<Vector> packed;
+	std::vector<Face> sorted(count);
+	std::vector<int> sorted_source(count);
+	for (int i = 0; i < count; i++)
+	{
+		Face tri = kept[key[i].second];
+		int* corner[3] = { &tri.v0, &tri.v1, &tri.v2 };
+		for (int k = 0; k < 3; k++)
+		{
+			if (number[*corner[k]] < 0)
+			{
+				number[*corner[k]] = (int)packed.size();
+				packed.push_back(V[*corner[k]]);
+			}
+			*corner[k] = number[*corner[k]];
+		}
+		sorted[i] = tri;
+		sorted_source[i] = source[key[i].second];
+	}
+	report.unused = vertices - report.welded - (int)packed.size();
+
+	V.swap(packed);
+	triangle.swap(sorted);
+	source.swap(sorted_source);
+}
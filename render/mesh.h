@@ -0,0 +1,32 @@
+/* mesh.h
+ * Mesh Cleanup Library
+ *
+ * Purpose: To shrink a parsed mesh before anything is built on it. Vertices closer than an epsilon are welded,
+ *          faces that lost an area are dropped, unused vertices are removed, and what is left is reordered along
+ *          a space filling curve so faces & vertices that are close in space are close in memory
+ *
+ * Assumptions: Faces index valid vertices. Shading & tie breaks use the face's index in the .ply file, so the
+ *              caller keeps the source index of every face that survives
+ */
+
+#pragma once
+
+#include "render2.h"
+
+/* Declare Classes */
+
+//Class holds how much the cleanup removed
+class MeshReport {
+public:
+	int vertices; //Vertices read from the .ply file
+	int welded; //Vertices merged into an earlier one within epsilon
+	int unused; //Vertices no face points to
+	int faces; //Faces read from the .ply file
+	int degenerate; //Faces with a repeated corner or zero area
+
+	MeshReport() : vertices(0), welded(0), unused(0), faces(0), degenerate(0) {}
+};
+
+/* Function Declarations */
+void clean_mesh(std::vector<Vector>& V, std::vector<Face>& triangle, std::vector<int>& source, float eps,
+	MeshReport& report); //Weld, drop degenerate faces & unused vertices, reorder for locality
@@ -0,0 +1,514 @@
+/* ply.cpp
+ * PLY Reader
+ *
+ * Purpose: To load a .ply mesh quickly. The file is memory mapped, the header is read line by line into elements & properties,
+ *          then the body is walked once. Ascii numbers are parsed in place with std::from_chars, binary values are copied
+ *          straight out of the mapping and byte swapped when the file's endianness differs from this machine's
+ *
+ * Assumptions: Only the vertex & face elements are kept, every other element is read past and thrown away
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <charconv>
+#include "render2.h"
+#include "mapped_file.h"
+#include "ply.h"
+
+//Body formats
+#define PLY_ASCII 0
+#define PLY_BINARY_LE 1
+#define PLY_BINARY_BE 2
+
+//Property types, PLY_NONE marks a property that is not a list
+#define PLY_NONE 0
+#define PLY_INT8 1
+#define PLY_UINT8 2
+#define PLY_INT16 3
+#define PLY_UINT16 4
+#define PLY_INT32 5
+#define PLY_UINT32 6
+#define PLY_FLOAT32 7
+#define PLY_FLOAT64 8
+
+/* Declare Structures */
+
+//Structure holds one property line of the header. Lists have a count type & an item type
+struct PlyProperty {
+	std::string name;
+	int type; //Type of the value, or of each list item
+	int count_type; //Type of the list length, PLY_NONE if not a list
+};
+
+//Structure holds one element of the header & its properties in file order
+struct PlyElement {
+	std::string name;
+	long count;
+	std::vector<PlyProperty> props;
+};
+
+/* Turn a type name from the header into a type, both the old (uchar) and new (uint8) names work
+ * name: Type name from the header
+ * Return the type, or PLY_NONE if unknown
+ */
+static int ply_type(const std::string& name)
+{
+	if (name == "char" || name == "int8") return PLY_INT8;
+	if (name == "uchar" || name == "uint8") return PLY_UINT8;
+	if (name == "short" || name == "int16") return PLY_INT16;
+	if (name == "ushort" || name == "uint16") return PLY_UINT16;
+	if (name == "int" || name == "int32") return PLY_INT32;
+	if (name == "uint" || name == "uint32") return PLY_UINT32;
+	if (name == "float" || name == "float32") return PLY_FLOAT32;
+	if (name == "double" || name == "float64") return PLY_FLOAT64;
+	return PLY_NONE;
+}
+
+/* Number of bytes a binary value of the given type takes
+ * type: Property type
+ */
+static int ply_size(int type)
+{
+	static const int size[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+	return size[type];
+}
+
+/* Declare Classes */
+
+//Class walks through the body of the file one value at a time, in ascii or binary
+class PlyCursor {
+public:
+	const char* p; //Next unread byte
+	const char* end; //One past the last byte of the file
+	int format; //PLY_ASCII, PLY_BINARY_LE or PLY_BINARY_BE
+	bool swap; //Binary values must be byte swapped for this machine
+	bool bad; //Set when a value could not be read, file is truncated or corrupt
+
+	PlyCursor(const char* _p, const char* _end, int _format) : p(_p), end(_end), format(_format), bad(false)
+	{
+		uint16_t probe = 1;
+		bool little = (*(const char*)&probe == 1);
+		swap = (format == PLY_BINARY_LE && !little) || (format == PLY_BINARY_BE && little);
+	}
+
+	/* Move past spaces & newlines between ascii values, return 0 at the end of the file */
+	int skip_space()
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+		if (p < end && *p == '+') p++; //from_chars doesn't take a leading +
+		return p < end;
+	}
+
+	/* Copy one binary value out of the file, byte swapped if needed
+	 * out: Where the raw bytes go
+	 * size: Number of bytes
+	 */
+	void raw(void* out, int size)
+	{
+		if (end - p < size)
+		{
+			bad = true;
+			p = end;
+			memset(out, 0, size);
+			return;
+		}
+		if (!swap) memcpy(out, p, size);
+		else for (int i = 0; i < size; i++) ((char*)out)[i] = p[size - 1 - i];
+		p += size;
+	}
+
+	/* Read one value of any type as a float or double. Ascii values are parsed straight into T, so a double keeps every digit
+	 * type: Property type
+	 */
+	template <typename T>
+	T read_real(int type)
+	{
+		if (format == PLY_ASCII)
+		{
+			T v = 0;
+			if (!skip_space()) bad = true;
+			std::from_chars_result res = std::from_chars(p, end, v);
+			if (res.ec != std::errc()) bad = true;
+			p = (res.ptr == p) ? end : res.ptr;
+			return v;
+		}
+		if (type == PLY_FLOAT32)
+		{
+			float v;
+			raw(&v, 4);
+			return v;
+		}
+		if (type == PLY_FLOAT64)
+		{
+			double v;
+			raw(&v, 8);
+			return (T)v;
+		}
+		return (T)read_int(type);
+	}
+
+	/* Read one value of any type as an integer
+	 * type: Property type
+	 */
+	long read_int(int type)
+	{
+		if (format == PLY_ASCII)
+		{
+			long v = 0;
+			if (!skip_space()) bad = true;
+			std::from_chars_result res = std::from_chars(p, end, v);
+			if (res.ec != std::errc()) bad = true;
+			p = (res.ptr == p) ? end : res.ptr;
+			return v;
+		}
+		switch (type)
+		{
+		case PLY_INT8: { int8_t v; raw(&v, 1); return v; }
+		case PLY_UINT8: { uint8_t v; raw(&v, 1); return v; }
+		case PLY_INT16: { int16_t v; raw(&v, 2); return v; }
+		case PLY_UINT16: { uint16_t v; raw(&v, 2); return v; }
+		case PLY_INT32: { int32_t v; raw(&v, 4); return v; }
+		case PLY_UINT32: { uint32_t v; raw(&v, 4); return v; }
+		case PLY_FLOAT32: { float v; raw(&v, 4); return (long)v; }
+		default: { double v; raw(&v, 8); return (long)v; }
+		}
+	}
+
+	/* Check that count values of at least size bytes each still fit in the file, before a count from the file sizes
+	 * an allocation. Sets bad otherwise, so a corrupt count is reported like any other unreadable value
+	 * count: Number of values the file claims
+	 * size: Fewest bytes one value can take, 1 for ascii
+	 * Return 1 if they fit, 0 otherwise
+	 */
+	int fits(long count, long size)
+	{
+		if (count < 0 || count > (end - p) / std::max<long>(size, 1)) bad = true;
+		return !bad;
+	}
+
+	/* Fewest bytes one element can take: binary properties at their size with every list empty, or 1 byte a value in ascii
+	 * element: Element from the header
+	 */
+	long stride(const PlyElement& element) const
+	{
+		if (format == PLY_ASCII) return (long)element.props.size();
+		long size = 0;
+		for (size_t j = 0; j < element.props.size(); j++)
+		{
+			const PlyProperty& prop = element.props[j];
+			size += ply_size(prop.count_type == PLY_NONE ? prop.type : prop.count_type);
+		}
+		return size;
+	}
+
+	/* Read past one value without keeping it
+	 * type: Property type
+	 */
+	void skip(int type)
+	{
+		if (format != PLY_ASCII)
+		{
+			if (end - p < ply_size(type)) bad = true;
+			p += std::min<long>(ply_size(type), end - p);
+			return;
+		}
+		if (!skip_space()) bad = true;
+		while (p < end && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') p++;
+	}
+
+	/* Read past a whole property, list or not
+	 * prop: Property to skip
+	 */
+	void skip(const PlyProperty& prop)
+	{
+		if (prop.count_type == PLY_NONE)
+		{
+			skip(prop.type);
+			return;
+		}
+		long n = read_int(prop.count_type);
+		for (long i = 0; i < n && !bad; i++) skip(prop.type);
+	}
+};
+
+/* Read the header, everything up to & including 'end_header'
+ * file: Mapped .ply file
+ * elements: Output elements in file order
+ * format: Output body format
+ * body: Output offset of the first byte after the header
+ * error: Output message if the header is not valid
+ * Return 1 on success, 0 otherwise
+ */
+static int read_header(const MappedFile& file, std::vector<PlyElement>& elements, int& format, size_t& body, std::string& error)
+{
+	size_t pos = 0;
+	int line_no = 0;
+	format = -1;
+
+	while (pos < file.size)
+	{
+		//Grab one line, works for \n and \r\n
+		const char* start = file.data + pos;
+		const char* nl = (const char*)memchr(start, '\n', file.size - pos);
+		size_t len = (nl != NULL) ? (size_t)(nl - start) : file.size - pos;
+		pos += len + 1;
+		std::string line(start, len);
+		if (!line.empty() && line.back() == '\r') line.pop_back();
+		line_no++;
+
+		std::istringstream words(line);
+		std::string word;
+		words >> word;
+
+		//Make sure user gives valid file type by reading 1st line in header
+		if (line_no == 1)
+		{
+			if (word != "ply")
+			{
+				error = "File must be a .ply file, run program again with correct file type";
+				return 0;
+			}
+			continue;
+		}
+
+		if (word == "format")
+		{
+			std::string kind;
+			words >> kind;
+			if (kind == "ascii") format = PLY_ASCII;
+			else if (kind == "binary_little_endian") format = PLY_BINARY_LE;
+			else if (kind == "binary_big_endian") format = PLY_BINARY_BE;
+			else
+			{
+				error = "Unknown .ply format '" + kind + "'";
+				return 0;
+			}
+		}
+		else if (word == "element")
+		{
+			PlyElement element;
+			if (!(words >> element.name >> element.count) || element.count < 0)
+			{
+				error = "Bad element line in header: " + line;
+				return 0;
+			}
+			elements.push_back(element);
+		}
+		else if (word == "property")
+		{
+			PlyProperty prop;
+			std::string type, count_type;
+			words >> type;
+			if (type == "list")
+			{
+				words >> count_type >> type;
+				prop.count_type = ply_type(count_type);
+				if (prop.count_type == PLY_NONE || prop.count_type == PLY_FLOAT32 || prop.count_type == PLY_FLOAT64)
+				{
+					error = "Bad list count type in header: " + line;
+					return 0;
+				}
+			}
+			else prop.count_type = PLY_NONE;
+			prop.type = ply_type(type);
+			words >> prop.name;
+			if (prop.type == PLY_NONE || prop.name.empty() || elements.empty())
+			{
+				error = "Bad property line in header: " + line;
+				return 0;
+			}
+			elements.back().props.push_back(prop);
+		}
+		else if (word == "end_header")
+		{
+			if (format < 0)
+			{
+				error = "Header is missing its format line";
+				return 0;
+			}
+			body = pos;
+			return 1;
+		}
+		//comment, obj_info and blank lines are ignored
+	}
+
+	error = "Header never reaches end_header";
+	return 0;
+}
+
+/* Read the vertex element, keeping x, y, z
+ * in: Cursor at the first vertex
+ * element: Vertex element from the header
+ * V: Output vertices, float or double
+ */
+template <typename T>
+static void read_vertices(PlyCursor& in, const PlyElement& element, std::vector<Vec3<T>>& V)
+{
+	int n = (int)element.props.size();
+	std::vector<int> slot(n, -1); //Which of x, y, z each property fills, -1 to skip
+	for (int j = 0; j < n; j++)
+	{
+		const PlyProperty& prop = element.props[j];
+		if (prop.count_type != PLY_NONE) continue;
+		if (prop.name == "x") slot[j] = 0;
+		else if (prop.name == "y") slot[j] = 1;
+		else if (prop.name == "z") slot[j] = 2;
+	}
+
+	if (!in.fits(element.count, in.stride(element))) return;
+	V.resize(element.count);
+	for (long i = 0; i < element.count && !in.bad; i++)
+	{
+		T xyz[3] = { 0, 0, 0 };
+		for (int j = 0; j < n; j++)
+		{
+			if (slot[j] >= 0) xyz[slot[j]] = in.read_real<T>(element.props[j].type);
+			else in.skip(element.props[j]);
+		}
+		V[i] = Vec3<T>(xyz[0], xyz[1], xyz[2]);
+	}
+}
+
+/* Read the face element, split every polygon into a fan of triangles
+ * in: Cursor at the first face
+ * element: Face element from the header
+ * vertices: Number of vertices, every index must be below this
+ * triangle: Output triangles
+ * error: Output message if an index is out of range
+ * Return 0 if an index is out of range, 1 otherwise. A file that ends early or claims more than it holds sets in.bad
+ */
+static int read_faces(PlyCursor& in, const PlyElement& element, int vertices, std::vector<Face>& triangle, std::string& error)
+{
+	int n = (int)element.props.size();
+	int list = -1;
+	for (int j = 0; j < n; j++)
+	{
+		const PlyProperty& prop = element.props[j];
+		if (prop.count_type != PLY_NONE && (prop.name == "vertex_indices" || prop.name == "vertex_index")) list = j;
+	}
+	if (list < 0)
+	{
+		error = "Face element has no vertex_indices list";
+		return 0;
+	}
+
+	triangle.clear();
+	if (!in.fits(element.count, in.stride(element))) return 1;
+	triangle.reserve(element.count);
+	std::vector<long> poly;
+	for (long i = 0; i < element.count && !in.bad; i++)
+	{
+		for (int j = 0; j < n; j++)
+		{
+			const PlyProperty& prop = element.props[j];
+			if (j != list)
+			{
+				in.skip(prop);
+				continue;
+			}
+
+			//Grab every point of the polygon
+			long points = in.read_int(prop.count_type);
+			if (!in.fits(points, in.format == PLY_ASCII ? 1 : ply_size(prop.type))) return 1;
+			poly.resize(points);
+			for (long k = 0; k < points; k++)
+			{
+				poly[k] = in.read_int(prop.type);
+				if (poly[k] < 0 || poly[k] >= vertices)
+				{
+					error = "Face " + std::to_string(i) + " uses vertex " + std::to_string(poly[k]) + ", file only has " + std::to_string(vertices);
+					return 0;
+				}
+			}
+
+			//Fan from the first point, a triangle gives exactly one face
+			for (long k = 1; k + 1 < points; k++) triangle.push_back(Face((int)poly[0], (int)poly[k], (int)poly[k + 1]));
+		}
+	}
+	return 1;
+}
+
+/* Read a .ply file into vertex & face tables
+ * filename: File to read
+ * V: Output vertices, float for the renderer or double to keep large coordinates exact until they are moved near 0
+ * triangle: Output triangles, polygons are split into fans
+ * error: Output message when the file can't be read
+ * Return 1 on success, 0 otherwise
+ */
+template <typename T>
+static int load_ply_as(const std::string& filename, std::vector<Vec3<T>>& V, std::vector<Face>& triangle, std::string& error)
+{
+	MappedFile file;
+	std::vector<PlyElement> elements;
+	int format;
+	size_t body;
+
+	//Check if we can find file given by user, otherwise exit to prevent segfault
+	if (!file.open(filename))
+	{
+		error = "Invalid open, make sure that file is located in the same folder as executable";
+		return 0;
+	}
+	if (!read_header(file, elements, format, body, error)) return 0;
+
+	//Walk the elements in file order, only vertex & face are kept
+	PlyCursor in(file.data + body, file.data + file.size, format);
+	bool have_vertex = false, have_face = false;
+	V.clear();
+	triangle.clear();
+	for (size_t e = 0; e < elements.size() && !in.bad; e++)
+	{
+		const PlyElement& element = elements[e];
+		if (element.name == "vertex")
+		{
+			read_vertices(in, element, V);
+			have_vertex = true;
+		}
+		else if (element.name == "face")
+		{
+			if (!have_vertex)
+			{
+				error = "Face element comes before the vertex element";
+				return 0;
+			}
+			if (!read_faces(in, element, (int)V.size(), triangle, error)) return 0;
+			have_face = true;
+		}
+		else
+		{
+			for (long i = 0; i < element.count && !in.bad; i++)
+			{
+				for (size_t j = 0; j < element.props.size(); j++) in.skip(element.props[j]);
+			}
+		}
+	}
+
+	if (in.bad)
+	{
+		error = "File ends early or has a value that is not a number";
+		return 0;
+	}
+	if (!have_vertex || !have_face)
+	{
+		error = "File needs both a vertex and a face element";
+		return 0;
+	}
+	return 1;
+}
+
+/* Read a .ply file with float vertices, see load_ply_as() */
+int load_ply(const std::string& filename, std::vector<Vector>& V, std::vector<Face>& triangle, std::string& error)
+{
+	return load_ply_as(filename, V, triangle, error);
+}
+
+/* Read a .ply file with double vertices, see load_ply_as() */
+int load_ply(const std::string& filename, std::vector<DVector>& V, std::vector<Face>& triangle, std::string& error)
+{
+	return load_ply_as(filename, V, triangle, error);
+}
@@ -0,0 +1,18 @@
+/* ply.h
+ * PLY Reader Library
+ *
+ * Purpose: To load vertices & faces from a .ply file. The header is parsed for real (elements & properties),
+ *          and the body can be ascii, binary_little_endian or binary_big_endian
+ *
+ * Assumptions: Vertices have x, y, z properties & faces have a vertex_indices (or vertex_index) list.
+ *              Faces with more than 3 points are split into a fan of triangles
+ */
+
+#pragma once
+
+#include "render2.h"
+
+/* Function Declarations */
+int load_ply(const std::string& filename, std::vector<Vector>& V, std::vector<Face>& triangle, std::string& error); //Read .ply, return 1 on success
+int load_ply(const std::string& filename, std::vector<DVector>& V, std::vector<Face>& triangle,
+	std::string& error); //Read .ply keeping double vertices, return 1 on success
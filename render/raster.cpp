@@ -0,0 +1,189 @@
+/* raster.cpp
+ * Scanline Rasterizer
+ *
+ * Purpose: To render the mesh by projecting each face onto the image plane once, instead of intersecting every pixel ray
+ *          with the scene. Faces are binned into bands of TILE rows, and each band is filled by one thread with its own z-buffer
+ *
+ * Assumptions: Pixel r,c samples the same point of the image plane as the ray caster, depth is the same ray distance n/d,
+ *              and faces are shaded 155 + index % 100, so raster & ray cast images can be diffed
+ */
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "render2.h"
+#include "thread_pool.h"
+#include "raster.h"
+
+#define RASTER_CHUNK 65536 //Vertices projected per thread pool job
+
+/* Project every vertex into image coordinates
+ * Ray through pixel r,c is <camera> + t(<O> + c<U> + r<W>), with <O> = <topleft - camera>, <U> one column step & <W> one row step.
+ * Solving <P - camera> = t<O> + tc<U> + tr<W> for a vertex P gives its pixel (c, r) & its ray distance t
+ * pool: Threads that share the work
+ * V: Table that stores all vertices from .ply file
+ * view: Camera & the 3D coordinates bounding the image
+ * sx: Output column of each vertex
+ * sy: Output row of each vertex
+ * inv_t: Output 1/t of each vertex, 0 or less if the vertex is behind the camera
+ */
+static void project(ThreadPool& pool, const std::vector<Vector>& V, const View& view, std::vector<float>& sx, std::vector<float>& sy,
+	std::vector<float>& inv_t)
+{
+	int vertices = (int)V.size();
+	Vector O = view.top_left - view.camera;
+	Vector U = (view.right - view.left) * (1.0f / view.col_span);
+	Vector W = (view.bottom - view.top) * (1.0f / view.row_span);
+
+	//Inverse of the matrix [O U W] by Cramer's rule, one row per unknown
+	Vector UxW = U.cross(W), WxO = W.cross(O), OxU = O.cross(U);
+	float det = v_dot_product(O, UxW);
+	UxW = UxW * (1.0f / det);
+	WxO = WxO * (1.0f / det);
+	OxU = OxU * (1.0f / det);
+
+	sx.resize(vertices);
+	sy.resize(vertices);
+	inv_t.resize(vertices);
+	pool.run((vertices + RASTER_CHUNK - 1) / RASTER_CHUNK, [&](int job) {
+		int end = std::min(vertices, (job + 1) * RASTER_CHUNK);
+		for (int i = job * RASTER_CHUNK; i < end; i++)
+		{
+			Vector P = V[i] - view.camera;
+			float t = v_dot_product(P, UxW); //Ray distance, 1 on the image plane
+			if (t <= 0)
+			{
+				inv_t[i] = 0; //Behind the camera
+				continue;
+			}
+			inv_t[i] = 1.0f / t;
+			sx[i] = v_dot_product(P, WxO) * inv_t[i];
+			sy[i] = v_dot_product(P, OxU) * inv_t[i];
+		}
+	});
+}
+
+/* Rasterize every face into the image with a z-buffer
+ * pool: Threads that share the bands of rows
+ * V: Table that stores all vertices from .ply file
+ * triangle: Table that stores all faces from .ply file
+ * source: Index in the .ply file of every face, used for shading & tie breaks
+ * view: Camera & the 3D coordinates bounding the image
+ * cull: 1 to skip faces wound clockwise on screen, the ones facing away from the camera
+ * image: Output image, every pixel is written, and its depth, face index & normal buffers if it has them
+ */
+void raster_render(ThreadPool& pool, const std::vector<Vector>& V, const std::vector<Face>& triangle, const std::vector<int>& source,
+	const View& view, int cull,
+	Framebuffer& image)
+{
+	int faces = (int)triangle.size();
+	int width = image.width, height = image.height;
+	int bands = (height + TILE - 1) / TILE;
+	std::vector<float> sx, sy, inv_t;
+	Vector O = view.top_left - view.camera; //Ray through pixel r,c is <O> + c<U> + r<W>
+	Vector U = (view.right - view.left) * (1.0f / view.col_span);
+	Vector W = (view.bottom - view.top) * (1.0f / view.row_span);
+
+	project(pool, V, view, sx, sy, inv_t);
+
+	//Bin each face into every band of rows it covers. Faces stay in index order inside each band
+	std::vector<std::vector<int>> band(bands);
+	for (int i = 0; i < faces; i++)
+	{
+		const Face& tri = triangle[i];
+		if (inv_t[tri.v0] <= 0 || inv_t[tri.v1] <= 0 || inv_t[tri.v2] <= 0) continue;
+
+		float ymin = std::min(sy[tri.v0], std::min(sy[tri.v1], sy[tri.v2]));
+		float ymax = std::max(sy[tri.v0], std::max(sy[tri.v1], sy[tri.v2]));
+		if (ymax < 0 || ymin > height - 1) continue;
+		int b0 = std::max(0, (int)ceilf(ymin)) / TILE;
+		int b1 = std::min(height - 1, (int)floorf(ymax)) / TILE;
+		for (int b = b0; b <= b1; b++) band[b].push_back(i);
+	}
+
+	//Fill each band on its own, z-buffer only needs to cover the band
+	pool.run(bands, [&](int b) {
+		int r0 = b * TILE;
+		int r1 = std::min(height, r0 + TILE);
+		std::vector<float> zBuffer((size_t)(r1 - r0) * width, FAR);
+		std::vector<int> close_face((size_t)(r1 - r0) * width, -1); //Index in triangle, not the .ply index
+
+		for (size_t k = 0; k < band[b].size(); k++)
+		{
+			int f = band[b][k];
+			const Face& tri = triangle[f];
+			int i = source[f];
+			float x0 = sx[tri.v0], y0 = sy[tri.v0], x1 = sx[tri.v1], y1 = sy[tri.v1], x2 = sx[tri.v2], y2 = sy[tri.v2];
+
+			//Twice the signed area, skip faces seen edge on. Rows run down the image, so faces toward the camera are negative
+			float area = (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0);
+			if (area == 0 || (cull && area > 0)) continue;
+			float inv_area = 1.0f / area;
+
+			//Pixels inside the face's bounding box & this band
+			int cmin = std::max(0, (int)ceilf(std::min(x0, std::min(x1, x2))));
+			int cmax = std::min(width - 1, (int)floorf(std::max(x0, std::max(x1, x2))));
+			int rmin = std::max(r0, (int)ceilf(std::min(y0, std::min(y1, y2))));
+			int rmax = std::min(r1 - 1, (int)floorf(std::max(y0, std::max(y1, y2))));
+
+			for (int r = rmin; r <= rmax; r++)
+			{
+				for (int c = cmin; c <= cmax; c++)
+				{
+					//Barycentric weights from the edge functions, pixel is inside when all three are >= 0 (edges count as inside)
+					float l0 = ((x1 - c) * (y2 - r) - (y1 - r) * (x2 - c)) * inv_area;
+					float l1 = ((x2 - c) * (y0 - r) - (y2 - r) * (x0 - c)) * inv_area;
+					float l2 = ((x0 - c) * (y1 - r) - (y0 - r) * (x1 - c)) * inv_area;
+					if (l0 < 0 || l1 < 0 || l2 < 0) continue;
+
+					//1/t is linear across the image, so interpolate it & flip back to the ray distance
+					float t = 1.0f / (l0 * inv_t[tri.v0] + l1 * inv_t[tri.v1] + l2 * inv_t[tri.v2]);
+					size_t p = (size_t)(r - r0) * width + c;
+					if (t < zBuffer[p] || (t == zBuffer[p] && close_face[p] >= 0 && i < source[close_face[p]]))
+					{
+						zBuffer[p] = t;
+						close_face[p] = f;
+					}
+				}
+			}
+		}
+
+		//Set pixel color depending on triangle found, same shading as the ray caster
+		for (int r = r0; r < r1; r++)
+		{
+			unsigned char* row = image.row(r);
+			for (int c = 0; c < width; c++)
+			{
+				int f = close_face[(size_t)(r - r0) * width + c];
+				row[c] = (f < 0) ? BLACK : 155 + (source[f] % 100);
+			}
+		}
+
+		//Extra buffers, same values the ray caster writes
+		for (int r = r0; r < r1 && (image.depth != NULL || image.id != NULL || image.normal != NULL); r++)
+		{
+			for (int c = 0; c < width; c++)
+			{
+				size_t q = (size_t)(r - r0) * width + c, p = (size_t)r * width + c;
+				int f = close_face[q];
+				if (image.depth != NULL)
+				{
+					Vector dir = O + U * (float)c + W * (float)r;
+					image.depth[p] = (f < 0) ? INFINITY : zBuffer[q] * sqrtf(v_dot_product(dir, dir));
+				}
+				if (image.id != NULL) image.id[p] = (f < 0) ? -1 : source[f];
+				if (image.normal != NULL)
+				{
+					Vector N;
+					if (f >= 0) N = (V[triangle[f].v1] - V[triangle[f].v0]).cross(V[triangle[f].v2] - V[triangle[f].v0]);
+					float length = sqrtf(v_dot_product(N, N));
+					if (length > 0) N = N * (1.0f / length);
+					image.normal[3 * p] = (length > 0) ? (unsigned char)lrintf(127.5f * (N.a + 1)) : 0;
+					image.normal[3 * p + 1] = (length > 0) ? (unsigned char)lrintf(127.5f * (N.b + 1)) : 0;
+					image.normal[3 * p + 2] = (length > 0) ? (unsigned char)lrintf(127.5f * (N.c + 1)) : 0;
+				}
+			}
+		}
+	});
+}
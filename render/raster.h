@@ -0,0 +1,18 @@
+/* raster.h
+ * Scanline Rasterizer Library
+ *
+ * Purpose: To render opaque meshes without casting a ray per pixel. Each face is projected onto the image once
+ *          and filled with a z-buffer, using the same camera & image plane as the ray caster
+ *
+ * Assumptions: Camera sits outside the bounding box (make_view puts it 1.5E from the center), so no face needs near plane clipping
+ */
+
+#pragma once
+
+#include "render2.h"
+#include "thread_pool.h"
+
+/* Function Declarations */
+void raster_render(ThreadPool& pool, const std::vector<Vector>& V, const std::vector<Face>& triangle, const std::vector<int>& source,
+	const View& view, int cull,
+	Framebuffer& image); //Rasterize every face into the image
@@ -0,0 +1,100 @@
+#!/bin/bash
+
+# regress.sh
+# Regression test & benchmark for the two front-ends of librender
+
+# Script to render the bundled models from fixed views with the brute force reference (reference.c),
+# render (C) and render2 (C++), check both front-ends against the reference, and time each one end to end.
+# The reference tests every face for every pixel with the original scalar hit test, so it shares no code
+# with the BVH, SIMD kernels or tiles. librender's watertight test may settle a pixel on a shared edge for
+# the other face, so up to $edge pixels per image may differ, any more is a failure.
+# The reference takes minutes a view on the bigger models.
+# Exits 1 if any image fails or no model was found
+#
+# Usage: ./regress.sh [model directory]
+#   ./regress.sh                       -- models in the current directory
+#   ./regress.sh ~/models
+
+dir=${1:-.}
+
+# set these lists with the parameter space's values
+models='cow airplane footbones big_porsche big_dodge dragon_vrip_res4'
+
+# camera rotations, X Y Z degrees
+views='0 0 0
+0 90 0
+45 30 60
+-30 15 200'
+
+# pixels allowed to differ from the reference in a 256x256 image, 0.1%
+edge=65
+
+# images go to a scratch directory, so the .ppm files next to the models are not overwritten
+render_ref=$(realpath ./reference)
+render_c=$(realpath ./render)
+render_cpp=$(realpath ./render2)
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+
+TIMEFORMAT=%R
+status=0
+checked=0
+
+# count the pixels of $2 that differ from the reference $1, -1 if the headers do not match
+differ()
+{
+    if [ ! -f "$2" ] || [ "$(head -c 15 "$1")" != "$(head -c 15 "$2")" ]
+    then
+        echo -1
+    else
+        cmp -l "$1" "$2" | wc -l
+    fi
+}
+
+printf "%-18s %-12s %11s %10s %10s %10s %10s  %s\n" "Model" "View" "reference s" "render s" "render2 s" "render px" "render2 px" "Result"
+for m in $models
+do
+    if [ ! -f "$dir/$m.ply" ]
+    then
+        echo "Skipping $m, $dir/$m.ply not found"
+        continue
+    fi
+    ln -s "$(realpath "$dir/$m.ply")" "$out/$m.ply"
+
+    while read x y z
+    do
+        # all three write $m.ppm at the default 256x256
+        ref_time=$( { time (cd "$out" && "$render_ref" $m.ply $x $y $z > /dev/null); } 2>&1 )
+        mv "$out/$m.ppm" "$out/$m.ref.ppm" 2> /dev/null
+        c_time=$( { time (cd "$out" && "$render_c" $m.ply $x $y $z > /dev/null); } 2>&1 )
+        mv "$out/$m.ppm" "$out/$m.c.ppm" 2> /dev/null
+        cpp_time=$( { time (cd "$out" && "$render_cpp" $m.ply $x $y $z > /dev/null); } 2>&1 )
+
+        if [ -f "$out/$m.ref.ppm" ]
+        then
+            c_px=$(differ "$out/$m.ref.ppm" "$out/$m.c.ppm")
+            cpp_px=$(differ "$out/$m.ref.ppm" "$out/$m.ppm")
+        else
+            c_px=-1
+            cpp_px=-1
+        fi
+
+        if [ $c_px -ge 0 ] && [ $c_px -le $edge ] && [ $cpp_px -ge 0 ] && [ $cpp_px -le $edge ]
+        then
+            result=same
+        else
+            result=DIFFERENT
+            status=1
+        fi
+        rm -f "$out/$m.ref.ppm" "$out/$m.c.ppm" "$out/$m.ppm"
+        checked=$((checked + 1))
+        printf "%-18s %-12s %11s %10s %10s %10s %10s  %s\n" "$m" "$x,$y,$z" "$ref_time" "$c_time" "$cpp_time" "$c_px" "$cpp_px" "$result"
+    done <<< "$views"
+done
+
+if [ $checked -eq 0 ]
+then
+    echo "No models found in $dir"
+    exit 1
+fi
+exit $status
@@ -1,42 +1,62 @@
-/* render.h
- * Triangle Rendering Library
- *
- * Purpose: To assist program in rendering triangles from an input .ply file, outputs to a PPM file
- *
- * Assumptions: User knows that render.c needs this library, and understands datatypes & macros
- */ 
-
-/* Define macros */
-#define COLS 256 
-#define ROWS 256 
-#define FLOAT_MAX 3.402823466e+38F 
-#define BLACK 0 
-#define FAR 999999
-
-/* Declare Structures */ 
-
-//Structure holds the vertices of a 3x1 matrix. Works for vertices with floats
-typedef struct { 
-	float a, b, c;
-} vector; 
-
-//Structure holds the faces of a 3x1 matrix. Meant to store triangle points
-typedef struct { 
-	int v0, v1, v2;
-} face; 
-
-/* Function Declarations */ 
-void v_max(float max[3], vector *V, int vertices); //Find max vertices for XYZ plane
-void v_min(float min[3], vector *V, int vertices); //Find min vertices for XYZ plane
-void v_center(float center[3], float max[3], float min[3]); //Find center vertices for XYZ plane
-float find_e(float max[3], float min[3]); //Find E scalar
-void create_rotate(float R[3][3], float R1[3][3], float R2[3][3]); //Create the 3x3 rotation matrix for XYZ plane
-void v_rotate(float product[3], float R[3][3], float V[3]); //Apply rotation onto given 3x1 vector
-void rotate(float cam[3], float up[3], float X, float Y, float Z); //Handle rotation of camera & up vector
-void v_add(float sum[3], float v1[3], float v2[3]); //Add two 3x1 vectors together
-void v_sub(float diff[3], float v1[3], float v2[3]); //Subtract two 3x1 vectors together
-void v_scal(float product[3], float v[3], float scal); //Apply scalar to 3x1 vector
-void v_cross_product(float product[3], float v1[3], float v2[3]); //Cross Product two 3x1 vectors
-float v_dot_product(float v1[3], float v2[3]); //Dot Product two 3x1 vectors
-void find_vector(float v[3], vector *table, int index); //Find vertices for given point on triangle
-void v_print (float vector[3]); //Print out 3x1 vector
\ No newline at end of file
+/* render.h
+ * Triangle Rendering Library
+ *
+ * Purpose: To give C programs the same renderer render2 uses. A model is loaded & prepared once, then any number of views
+ *          are rendered into the caller's pixel buffer. librender.cpp implements it on top of the C++ Engine in engine.h
+ *
+ * Assumptions: User links librender.a with a C++ linker, since the library needs the C++ runtime, and understands datatypes & macros
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Define macros */
+#ifndef COLS
+#define COLS 256 //Default image width
+#define ROWS 256 //Default image height
+#endif
+
+//Engines of render_options.engine
+#define RENDER_RAY 0 //Cast a ray per pixel through the BVH
+#define RENDER_RASTER 1 //Project each face once into a z-buffer
+
+//Shading of render_options.shade
+#define RENDER_SHADE_INDEX 0 //Grey of 155 + face index % 100
+#define RENDER_SHADE_LAMBERT 1 //Lit from one direction
+
+/* Declare Structures */
+
+//Structure holds a loaded model & everything built on it. Only librender.cpp sees inside
+typedef struct render_scene render_scene;
+
+//Structure holds the choices render2 takes as options, fill with render_default_options() first
+typedef struct {
+	int threads; //Threads that render tiles, 0 for every core
+	int kernel; //Triangle test: -1 auto, 0 scalar, 1 sse, 2 avx2, 3 double
+	int engine; //RENDER_RAY or RENDER_RASTER
+	int cull; //1 to skip triangles facing away from the camera
+	int frustum; //1 to cull each tile's BVH subtrees against its frustum before casting
+	int clean; //1 to weld vertices & drop degenerate faces before building anything
+	float weld_eps; //Weld distance of clean, below 0 picks one from the model size
+	int precision; //0 float, 1 local (double setup, float hit tests near the model's center), 2 double
+	int aa; //Strata per side of each edge pixel, 1 for one ray per pixel (ray engine only)
+	int cache; //Megabytes of chunks held in memory when the model is an .rchunks file, rendered out of core
+	int shade; //RENDER_SHADE_INDEX or RENDER_SHADE_LAMBERT (ray engine only)
+	int shadows; //1 to cast a shadow ray from every lit pixel, RENDER_SHADE_LAMBERT only
+	float light[3]; //Direction towards the light in model coordinates, any length but 0
+} render_options;
+
+/* Function Declarations */
+void render_default_options(render_options *options); //Same defaults as render2
+render_scene *render_open(const char *filename, const render_options *options, char *error,
+	int error_size); //Load a .ply, .rscene or .rchunks file, NULL on failure with the reason in error
+int render_view(render_scene *scene, float X, float Y, float Z, int width, int height,
+	unsigned char *pixel); //Render one view into width * height greyscale pixels, row by row. Return 1 on success
+void render_close(render_scene *scene); //Free a scene from render_open()
+
+#ifdef __cplusplus
+}
+#endif
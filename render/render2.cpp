@@ -2,8 +2,9 @@
  * Triangle Rendering
  *
  * Purpose: To render triangles from an input .ply file, outputs to a PPM file. Now in C++!
+ *          This is the C++ front-end: options, views & output files. The pipeline itself is the Engine in engine.cpp
  *
- * Assumptions: User inputs a .ply that plots triangles, so faces always have 3 points.
+ * Assumptions: User inputs a .ply that plots triangles. Faces with more points are split into triangles by the reader.
  * 		User knows that camera defaults to <1,0,0>, their input only rotates the camera
  *
  * The program accepts one command line argument, including the name of the file and rotation angles (Ex. 'file.ply 90 -45 20')
@@ -11,429 +12,403 @@
 
 #include <iostream> 
 #include <cstdlib>
+#include <cstdio>
 #include <vector>
 #include <fstream> 
 #include <sstream>
 #include <string>
-#include <cmath> 
+#include <algorithm>
+#include <memory>
+#include <chrono>
+#include <sys/resource.h>
 #include "render2.h" 
-
-/* Find max vector
- * V: A structure holding all the given input vertices
- * vertices: The amount of vertices in the input file
+#include "tri_table.h"
+#include "bvh.h"
+#include "engine.h"
+
+/* Write a group of images, to .ppm files or one after another to stdout
+ * image: Images to write
+ * n: Number of images
+ * first: View number of image[0]
+ * base: Model filename without its extension
+ * batch: Number the files name_0000.ppm, name_0001.ppm, ...
+ * suffix: Added to the name before .ppm, empty for the final image
+ * stream: Write the images to stdout instead of files
+ * msg: Where progress messages go
+ * Return 1 on success, 0 if a file couldn't be written
  */
-Vector v_max(const std::vector<Vector>& V, int vertices)
+static int write_views(Framebuffer* const* image, int n, int first, const std::string& base, bool batch, const std::string& suffix,
+	bool stream, std::ostream& msg)
 {
-	//Assign min variable to hold temporarily
-	float max_A = -FLOAT_MAX;
-	float max_B = -FLOAT_MAX;
-	float max_C = -FLOAT_MAX;
-
-	//Go through all vertices, find max of each element
-	for (int i = 0; i < vertices; i++)
+	for (int g = 0; g < n; g++)
 	{
-		if (max_A < V[i].a) max_A = V[i].a;
-		if (max_B < V[i].b) max_B = V[i].b;
-		if (max_C < V[i].c) max_C = V[i].c;
-	}
-
-	//Found max, assign into given array 
-	return Vector(max_A, max_B, max_C);
-}
-
-/* Find min vector
- * V: A structure holding all the given input vertices
- * vertices: The amount of vertices in the input file
- */
-Vector v_min(const std::vector<Vector>& V, int vertices)
-{
-	//Assign max variable to hold temporarily
-	float min_A = FLOAT_MAX;
-	float min_B = FLOAT_MAX;
-	float min_C = FLOAT_MAX;
+		if (stream)
+		{
+			if (!write_ppm(std::cout, *image[g])) return 0;
+			std::cout.flush(); //A viewer on the pipe should see each frame as soon as it is done
+			continue;
+		}
 
-	//Go through all vertices, find min of each element
-	for (int i = 0; i < vertices; i++)
-	{
-		if (min_A > V[i].a) min_A = V[i].a;
-		if (min_B > V[i].b) min_B = V[i].b;
-		if (min_C > V[i].c) min_C = V[i].c;
+		std::string newfilename = base + suffix + ".ppm"; //New file should be the same name, with new extension
+		if (batch)
+		{
+			char number[16];
+			snprintf(number, sizeof(number), "_%04d", first + g);
+			newfilename = base + number + suffix + ".ppm";
+		}
+		if (!write_ppm(newfilename, *image[g]))
+		{
+			msg << "Could not write " << newfilename << std::endl;
+			return 0;
+		}
+		msg << "Outputting to " << newfilename << std::endl;
 	}
-
-	//Found min, assign into given array 
-	return Vector(min_A, min_B, min_C);
-}
-
-/* Find center vector (min + max)/2
- * max: Given vector to hold maximum x,y,z values
- * min: Given vector to hold minimum x,y,z values
- */
-Vector v_center(Vector max, Vector min)
-{
-	return Vector((max.a + min.a) / 2, (max.b + min.b) / 2, (max.c + min.c) / 2);
+	return 1;
 }
 
-/* Find E scalar of bounding box, largest component of <max-min> or largest extent of the three axes
- * max: Given vertex to hold maximum x,y,z values
- * min: Given vertex to hold minimum x,y,z values
+/* Write the extra buffers of the final images next to them, name.pfm, name.tid & name_normal.ppm
+ * image: Images to write
+ * n: Number of images
+ * first: View number of image[0]
+ * base: Model filename without its extension
+ * batch: Number the files name_0000.pfm, name_0001.pfm, ...
+ * msg: Where progress messages go
+ * Return 1 on success, 0 if a file couldn't be written
  */
-float find_e(Vector max, Vector min)
+static int write_aux_views(Framebuffer* const* image, int n, int first, const std::string& base, bool batch, std::ostream& msg)
 {
-	//Assign temporary value for e
-	float e = -FLOAT_MAX;
-
-	//Grab extents of each axis
-	float temp_X = max.a - min.a;
-	float temp_Y = max.b - min.b;
-	float temp_Z = max.c - min.c;
-
-	//Find largest extent 
-	e = temp_X;
-	if (e < temp_Y) e = temp_Y;
-	if (e < temp_Z) e = temp_Z;
-
-	return e;
-}
-
-/* Create Rotation matrix by multiplying a 3x3 matrix by another 3x3 matrix. Output is a 3x3 matrix
- * R: Our output matrix, stores the product of the two input matrices
- * R1: One of the input matrices. First one R1*R2
- * R2: One of the input matrices. Second one R1*R2
- */
-void create_rotate(float R[3][3], float R1[3][3], float R2[3][3])
-{
-	//Go through entire 3x3 matrix. Go through each row at a time
-	for (int i = 0; i < 3; i++)
+	for (int g = 0; g < n; g++)
 	{
-		//Set to zero to allow for incrementation
-		R[i][0] = 0;
-		R[i][1] = 0;
-		R[i][2] = 0;
-
-		//Go through each column in the row, adding all the multiplications between the two matrices
-		for (int j = 0; j < 3; j++)
+		std::string name = base;
+		if (batch)
+		{
+			char number[16];
+			snprintf(number, sizeof(number), "_%04d", first + g);
+			name = base + number;
+		}
+		if (!write_aux(name, *image[g]))
 		{
-			R[i][0] += R1[i][j] * R2[j][0];
-			R[i][1] += R1[i][j] * R2[j][1];
-			R[i][2] += R1[i][j] * R2[j][2];
+			msg << "Could not write the depth, index or normal buffer of " << name << std::endl;
+			return 0;
 		}
 	}
+	return 1;
 }
 
-/* Apply rotation by multiplying a 3x3 matrix by a 3x1 matrix. Output is a 3x1 matrix that is rotated around all axes (XYZ)
- * product: Our output matrix, stores the product of the two input matrices
- * R: Input 3x3 matrix. First matrix in the multiplication order
- * V: Input 3x1 matrix. Second matrix in the multiplication order 
- * Note: Wish I kept this in original C implementation, but doesn't hurt to practice
+/* Read a list of camera rotations, one 'X Y Z' per line. Blank lines & lines starting with # are skipped
+ * filename: Text file of rotations
+ * rotation: Output rotations, 3 floats per view
+ * Return 1 on success, 0 if the file couldn't be read
  */
-void v_rotate(Vector product, float R[3][3], Vector V)
-{ 
-	//Go through entire 3x3 matrix. Go through each row at a time
-	product.a = (R[0][0] * V.a) + (R[0][1] * V.b) + (R[0][2] * V.c);
-	product.b = (R[1][0] * V.a) + (R[1][1] * V.b) + (R[1][2] * V.c);
-	product.c = (R[2][0] * V.a) + (R[2][1] * V.b) + (R[2][2] * V.c);
-}
-
-/* Rotate the camera & up vectors by the given degrees
- * cam: Provided camera vector that will be rotated. Default <1, 0, 0>
- * up: Provided up vector that will be rotated. Default <0, 0, 1>
- * X: Degrees that camera & up vectors will be rotated about the X axis, given by user input
- * Y: Degrees that camera & up vectors will be rotated about the Y axis, given by user input
- * Z: Degrees that camera & up vectors will be rotated about the Z axis, given by user input
- */
-void rotate(Vector cam, Vector up, float X, float Y, float Z)
+static int read_views(const std::string& filename, std::vector<Vector>& rotation)
 {
-	//Convert degree input into radians for cmath trig functions 
-	float radX = X * (PI / 180.0);
-	float radY = Y * (PI / 180.0);
-	float radZ = Z * (PI / 180.0);
-
-	//Set up rotation matrix for X, Y, Z
-	float Rx[3][3] = { {1, 0, 0}, {0, cos(radX), -sin(radX)}, {0, sin(radX), cos(radX)} };
-	float Ry[3][3] = { {cos(radY), 0, sin(radY)}, {0, 1, 0}, {-sin(radY), 0, cos(radY)} };
-	float Rz[3][3] = { {cos(radZ), -sin(radZ), 0}, {sin(radZ), cos(radZ), 0}, {0, 0, 1} };
-
-	//Create matrices to store products & old vectors for purposes of matrix multiplication
-	float R[3][3], temp_R[3][3]; 
-
-	//Create temporary arrays to hold old cam/up vectors
-	Vector temp_cam = Vector(cam.a, cam.b, cam.c);  
-	Vector temp_up = Vector(up.a, up.b, up.c);
-
-
-	//Find rotation matrix Rz*(Ry*Rx)
-	create_rotate(temp_R, Ry, Rx); //Ry * Rx
-	create_rotate(R, Rz, temp_R); //Rz * (Ry * Rx) 
+	std::ifstream infile(filename);
+	if (!infile.is_open()) return 0;
 
-	//Rotate camera & up vectors around the X-axis, Y-axis, Z-axis
-	v_rotate(cam, R, temp_cam);
-	v_rotate(up, R, temp_up);
-}
-
-/* Dot Multiply two 3x1 matrices
- * v1: Input 3x1 matrix
- * v2: Input 3x1 matrix
- * Return product: Result of the dot multiplication (Scalar)
- */
-float v_dot_product(Vector v1, Vector v2)
-{
-	return (v1.a * v2.a) + (v1.b * v2.b) + (v1.c * v2.c);
-}
-
-/* Find vertices for a point on the triangle, depending on the vector index & vector table
- * v: Output 3x1 matrix, will be assigned vertices depending on found vector
- * table: Table that stores all vertices from .ply file
- * index: Specific vector that the face from .ply file wants, to assign vertice for triangle edge
- */
-Vector find_vector(const std::vector<Vector>& table, int index)
-{
-	return Vector(table[index].a, table[index].b, table[index].c);
+	std::string line;
+	while (std::getline(infile, line))
+	{
+		std::istringstream words(line);
+		float X, Y, Z;
+		if (line.empty() || line[0] == '#') continue;
+		if (!(words >> X >> Y >> Z)) return 0;
+		rotation.push_back(Vector(X, Y, Z));
+	}
+	return 1;
 }
 
 /* Handle user input & begin Triangle Rendering */
 int main(int argc, char* argv[])
 {
-	unsigned char pixel[ROWS][COLS];
-	int close_tri, vertices, faces; 
-	Vector camera, up, max, min, center, left, right, top, bottom; 
-	Vector top_left, diff, diff1, sum, image, ABC, v0, v1, v2; 
-	Vector intersect, prod1, prod2;
-	float X, Y, Z, E, a, D, n, d;
-	float zBuffer, dot1, dot2, dot3;
+	EngineOptions options; //Defaults to every core, the widest SIMD kernel, float precision & frustum culling
+	int width = COLS, height = ROWS; //Default image size
+	int stats = 0; //1 to print timings & ray counts at the end
+	int progressive = 0; //1 to write coarse passes before the final image
+	int stream = 0; //1 to write images to stdout instead of files
+	std::string save_file; //.rscene file to export the prepared scene to
+	std::string chunk_file; //.rchunks file the model is split into & rendered from out of core
+	int want_depth = 0, want_id = 0, want_normal = 0; //Extra buffers written next to each image
+	int turntable = 0; //Number of frames spun around the Z axis, 0 for a single image
+	std::string engine = "ray"; //Ray caster, or the z-buffer rasterizer
+	std::string views_file; //File of camera rotations for batch rendering
+	std::vector<char*> args; //Arguments that are not options: filename & the three degrees
+	std::vector<Vector> rotation; //X, Y, Z degrees of every view
+
+	//Split options from the regular arguments
+	for (int i = 1; i < argc; i++)
+	{
+		std::string opt = argv[i];
+		if (opt == "--threads" && i + 1 < argc) options.threads = atoi(argv[++i]);
+		else if (opt == "--width" && i + 1 < argc) width = atoi(argv[++i]);
+		else if (opt == "--height" && i + 1 < argc) height = atoi(argv[++i]);
+		else if (opt == "--turntable" && i + 1 < argc) turntable = atoi(argv[++i]);
+		else if (opt == "--views" && i + 1 < argc) views_file = argv[++i];
+		else if (opt == "--engine" && i + 1 < argc) engine = argv[++i];
+		else if (opt == "--cull") options.cull = 1;
+		else if (opt == "--stats") stats = 1;
+		else if (opt == "--progressive") progressive = 1;
+		else if (opt == "--stream") stream = 1;
+		else if (opt == "--clean") options.clean = 1;
+		else if (opt == "--no-frustum") options.frustum = 0;
+		else if (opt == "--depth") want_depth = 1;
+		else if (opt == "--ids") want_id = 1;
+		else if (opt == "--normals") want_normal = 1;
+		else if (opt == "--save-scene" && i + 1 < argc) save_file = argv[++i];
+		else if (opt == "--aa" && i + 1 < argc) options.aa = atoi(argv[++i]);
+		else if (opt == "--save-chunks" && i + 1 < argc) chunk_file = argv[++i];
+		else if (opt == "--chunk-faces" && i + 1 < argc) options.chunk_faces = atoi(argv[++i]);
+		else if (opt == "--cache" && i + 1 < argc) options.cache = atoi(argv[++i]);
+		else if (opt == "--shadows")
+		{
+			options.shade = SHADE_LAMBERT;
+			options.shadows = 1;
+		}
+		else if (opt == "--shade" && i + 1 < argc)
+		{
+			std::string m = argv[++i];
+			options.shade = (m == "index") ? SHADE_INDEX : ((m == "lambert") ? SHADE_LAMBERT : -1);
+		}
+		else if (opt == "--light" && i + 3 < argc)
+		{
+			float X = atof(argv[++i]);
+			float Y = atof(argv[++i]);
+			options.light = Vector(X, Y, atof(argv[++i]));
+		}
+		else if (opt == "--precision" && i + 1 < argc)
+		{
+			std::string m = argv[++i];
+			options.precision = (m == "float") ? PRECISION_FLOAT : ((m == "local") ? PRECISION_LOCAL : ((m == "double") ? PRECISION_DOUBLE : -1));
+		}
+		else if (opt == "--weld" && i + 1 < argc)
+		{
+			options.clean = 1;
+			options.weld_eps = atof(argv[++i]);
+		}
+		else if (opt == "--kernel" && i + 1 < argc)
+		{
+			std::string k = argv[++i];
+			options.kernel = (k == "scalar") ? KERNEL_SCALAR : ((k == "sse") ? KERNEL_SSE : ((k == "avx2") ? KERNEL_AVX2
+				: ((k == "double") ? KERNEL_DOUBLE : KERNEL_AUTO)));
+		}
+		else args.push_back(argv[i]);
+	}
 
-	//Make sure user enters correct # of arguments
-	if (argc != 5)
+	//Make sure user enters correct # of arguments, degrees come from the views file in batch mode. The Engine checks its own options
+	options.raster = (engine == "raster");
+	options.out_of_core = !chunk_file.empty();
+	options.progressive = progressive;
+	std::string error;
+	bool usable = options.check(error);
+	if ((args.size() != 4 && !(args.size() == 1 && !views_file.empty())) || width < 1 || height < 1 || turntable < 0
+		|| (engine != "ray" && engine != "raster") || !usable)
 	{
-		std::cout << "Program use is . / render 'filename' degree1 degree2 degree3" << std::endl;
-		std::cout << "Degrees are for the camera rotation" << std::endl;
+		if (!usable) std::cout << error << std::endl;
+		std::cout << "Program use is . / render 'filename' degree1 degree2 degree3 [--width W] [--height H] [--threads N] [--kernel K]" << std::endl;
+		std::cout << "                                                 [--turntable N] [--views FILE] [--engine E] [--cull] [--stats]" << std::endl;
+		std::cout << "                                                 [--progressive] [--stream] [--clean] [--weld EPS] [--no-frustum]" << std::endl;
+		std::cout << "                                                 [--save-scene FILE] [--depth] [--ids] [--normals] [--precision P]" << std::endl;
+		std::cout << "                                                 [--aa N] [--save-chunks FILE] [--chunk-faces N] [--cache MB]" << std::endl;
+		std::cout << "                                                 [--shade S] [--light X Y Z] [--shadows]" << std::endl;
+		std::cout << "Degrees are for the camera rotation. 'filename' is a .ply file, an .rscene file saved by --save-scene" << std::endl;
+		std::cout << "or an .rchunks file saved by --save-chunks, which is rendered out of core" << std::endl;
+		std::cout << "--width W & --height H set the image size, default 256x256" << std::endl;
+		std::cout << "--turntable N renders N views spun 360 degrees about the Z axis, starting at the given degrees" << std::endl;
+		std::cout << "--views FILE renders one view per 'X Y Z' line of FILE, degrees on the command line are not needed" << std::endl;
+		std::cout << "--threads N renders tiles on N threads, 0 (default) uses every core" << std::endl;
+		std::cout << "--kernel K picks the triangle test: scalar, sse, avx2, double or auto (default)" << std::endl;
+		std::cout << "--engine E picks ray (default) to cast a ray per pixel, or raster to project each face once" << std::endl;
+		std::cout << "--cull skips triangles facing away from the camera, for closed meshes wound counter clockwise" << std::endl;
+		std::cout << "--stats prints parse, setup & render times, rays per second, triangle tests per ray & hit rate" << std::endl;
+		std::cout << "--progressive casts every 8th pixel first, then every 4th & 2nd, writing name_pass8.ppm ... before name.ppm (ray engine only)" << std::endl;
+		std::cout << "--stream writes every image & pass to stdout as binary PPM instead of files, messages go to stderr" << std::endl;
+		std::cout << "--clean welds vertices within 1e-6 of the model size, drops degenerate faces & unused vertices, and sorts the rest" << std::endl;
+		std::cout << "--weld EPS does the same with vertices welded within EPS, 0 for exact duplicates only" << std::endl;
+		std::cout << "--save-scene FILE also writes the parsed & cleaned mesh, with the BVH for the ray engine, to an .rscene file" << std::endl;
+		std::cout << "--depth, --ids & --normals also write name.pfm (float distance), name.tid (32 bit face index)" << std::endl;
+		std::cout << "                              & name_normal.ppm (face normal as color), from the same pass" << std::endl;
+		std::cout << "--precision P is float (default), local to parse .ply vertices & set up the camera in double, then trace in float" << std::endl;
+		std::cout << "              relative to the model's center, or double to also run the hit test in double (slow reference)" << std::endl;
+		std::cout << "--aa N supersamples pixels on face & depth edges with N x N jittered rays, N up to 8 (ray engine only)" << std::endl;
+		std::cout << "--save-chunks FILE splits the model into spatial chunks, each with its own BVH, writes them to an .rchunks file" << std::endl;
+		std::cout << "                   & renders out of core from it, reading only the chunks each tile can see (ray engine only)" << std::endl;
+		std::cout << "--chunk-faces N puts at most N faces in one chunk, default " << CHUNK_FACES << std::endl;
+		std::cout << "--cache MB keeps at most MB megabytes of chunks in memory when rendering out of core, default " << CHUNK_CACHE << std::endl;
+		std::cout << "--shade S is index (default) to shade faces 155 + index % 100, or lambert to light them from one direction (ray engine only)" << std::endl;
+		std::cout << "--light X Y Z points towards the light in model coordinates for lambert, default 1 1 1" << std::endl;
+		std::cout << "--shadows shades lambert & casts a shadow ray from every lit pixel, stopping at the first face in the way" << std::endl;
+		std::cout << "--no-frustum traverses the whole BVH for every pixel instead of the boxes inside each tile's frustum" << std::endl;
 		return 1;
 	}
 
-	//Grab user input for filename
-	std:: string filename = argv[1];
+	bool aux = want_depth || want_id || want_normal;
+	std::ostream& msg = stream ? std::cerr : std::cout; //Keep stdout clean for the images when streaming
+	FILE* info = stream ? stderr : stdout;
 
-	/* Parse through .ply file, grab vertices & faces */
-	std::ifstream infile(filename, std::ios::binary);
+	//Grab user input for filename
+	std:: string filename = args[0];
 
-	//Check if we can find file given by user, otherwise exit to prevent segfault
-	if (!infile.is_open())
+	/* Parse through .ply file, grab vertices & faces, then build the BVH & table. An .rscene file is mapped instead,
+	 * its BVH & table are used in place */
+	Engine model(options);
+	if (!model.load(filename, error))
 	{
-		std::cout << "Invalid open, make sure that file is located in the same folder as executable" << std::endl;
+		msg << error << std::endl;
 		return 1;
 	}
-
-	//Go through header 
-	std::string header;
-	std::getline (infile, header); 
-	header.erase(std::remove_if(header.begin(), header.end(), ::isspace), header.end());
-	//Make sure user gives valid file type by reading 1st line in header
-	if (header != "ply")
+	if (options.clean)
 	{
-		std::cout << "File must be a .ply file, run program again with correct file type" << std::endl; 
-		std::cout << header << std::endl;
-		infile.close();
-		return 1;
-	} 
-	std::string line; 
-	std::getline(infile, line); 
-	std::getline(infile, line); 
-    vertices = std::stoi(line.substr(15)); //Grab # vertices after 'element vertex ' from previously read line
-	std::getline(infile, line);
-	std::getline(infile, line);
-	std::getline(infile, line); 
-	std::getline(infile, line); 
-	faces = std::stoi(line.substr(13)); //Grab # faces, or # triangles after 'element faces ' from previously read line
-	std::getline(infile, line);
-	std::getline(infile, line);
-
-	//Create vertex & face structs to hold in vertices & faces from .ply file
-	std::vector <Vector> V(vertices);
-	std::vector <Face> triangle(faces); 
+		const MeshReport& report = model.report;
+		msg << "Cleaned mesh: welded " << report.welded << " & dropped " << report.unused << " unused of " << report.vertices
+			<< " vertices, dropped " << report.degenerate << " degenerate of " << report.faces << " faces" << std::endl;
+	}
+	double write_time = 0;
 
-	//Collect vertices 
-	for (int i = 0; i < vertices; i++)
+	/* Export the prepared scene, so the next run can skip parsing & setup */
+	if (!save_file.empty())
 	{
-		infile >> V[i].a >> V[i].b >> V[i].c;
+		if (!model.save(save_file, error))
+		{
+			msg << error << std::endl;
+			return 1;
+		}
+		msg << "Saved scene to " << save_file << (options.raster || options.out_of_core ? "" : " with its BVH") << std::endl;
 	}
 
-	int temp; //Stores 3 in front of each triangle
-
-	//Collect faces (or triangles)
-	for (int i = 0; i < faces; i++)
+	/* Split the model into chunks on disk, then free it & render out of core */
+	if (!chunk_file.empty())
 	{
-		infile >> temp >> triangle[i].v0 >> triangle[i].v1 >> triangle[i].v2;
+		if (!model.save_chunks(chunk_file, error))
+		{
+			msg << error << std::endl;
+			return 1;
+		}
+		msg << "Saved " << model.chunks.entry.size() << " chunk(s) to " << chunk_file << std::endl;
 	}
 
-	infile.close(); //Done with parsing 
-
-	/* Calculate the bounding box on the vertices */
+	/* Calculate camera position and orientation of every view */
 
-	max = v_max(V, vertices); 
-	min = v_min(V, vertices); 
-	center = v_center(max, min); 
-	E = find_e(max, min); 
-
-	/* Calculate camera position and orientation */
-
-	//Grab rotations from user and default camera, convert input into floats
-	X = atof(argv[2]);
-	Y = atof(argv[3]);
-	Z = atof(argv[4]);
-
-	//Default camera onto X axis (<1,0,0>) 
-	camera = Vector(1.0, 0.0, 0.0);
-
-	//Default up onto Z axis (<0,0,1>) 
-	up = Vector(0.0, 0.0, 1.0);
-
-	//Rotate camera & up vector
-	rotate(camera, up, X, Y, Z);
-
-	//Move and scale the camera vector (<camera> = 1.5E<camera> + <center>) 
-	camera = camera * (1.5 * E); //<camera> = 1.5E*<camera> 
-	camera = camera + center; //<camera> = 1.5e*<camera> + center 
-
-	/* Determine the 3D coordinates bounding the image */
+	//Grab rotations from user, convert input into floats
+	if (!views_file.empty())
+	{
+		if (!read_views(views_file, rotation) || rotation.empty())
+		{
+			msg << "Could not read camera rotations from " << views_file << std::endl;
+			return 1;
+		}
+	}
+	else
+	{
+		float X = atof(args[1]);
+		float Y = atof(args[2]);
+		float Z = atof(args[3]);
+		if (turntable == 0) rotation.push_back(Vector(X, Y, Z));
+		for (int f = 0; f < turntable; f++) rotation.push_back(Vector(X, Y, Z + 360.0f * f / turntable));
+	}
+	int count = (int)rotation.size();
+	bool batch = (count > 1 || !views_file.empty() || turntable > 0);
 
-	//Find first left
-	diff = center - camera;//<diff> = <center> - <camera> 
-	left = up.cross(diff); //<left> = <up> x <center-camera> 
+	/* Handle new file name, batch views are numbered name_0000.ppm, name_0001.ppm, ... */
+	size_t ext_pos = filename.find_last_of('.'); //Find location of file extension in filename
+	if (ext_pos != std::string::npos) filename = filename.substr(0, ext_pos); //Get rid of old extension, if it exists 
 
-	//Find a = ||<left>||
-	a = sqrtf((left.a * left.a) + (left.b * left.b) + (left.c * left.c));
+	/* Determine each pixel r,c of every view. A group of views renders at once so all threads stay busy,
+	 * but only a few images are held in memory at a time */
+	int group = batch ? model.pool.size() : 1;
+	std::vector<View> view(group);
+	std::vector<std::unique_ptr<Framebuffer>> image;
+	std::vector<Framebuffer*> image_ptr;
+	for (int g = 0; g < group; g++)
+	{
+		image.push_back(std::unique_ptr<Framebuffer>(new Framebuffer(width, height)));
+		image.back()->add_aux(want_depth, want_id, want_normal);
+		image_ptr.push_back(image.back().get());
+	}
+	msg << "Rendering " << count << " view(s) at " << width << "x" << height << " with " << model.pool.size() << " thread(s), ";
+	if (model.chunks.is_open()) msg << kernel_name(model.kernel) << " kernel, out of core with a " << options.cache << " MB cache..." << std::endl;
+	else if (engine == "ray") msg << kernel_name(model.kernel) << " kernel..." << std::endl;
+	else msg << "rasterizer..." << std::endl;
 
-	//Find final left
-	left = left * (E / (2 * a)); //<left> = E/2a<left> 
-	left = left + center;//<left> = E/2a<left> + center  
+	for (int first = 0; first < count; first += group)
+	{
+		int n = std::min(group, count - first);
+		for (int g = 0; g < n; g++) model.view(view[g], rotation[first + g].a, rotation[first + g].b, rotation[first + g].c, width, height);
+		if (!progressive) model.render(view.data(), image_ptr.data(), n);
 
-	//Find right
-	right = diff.cross(up); //right = <center-camera> x <up> 
-	right = right * (E / (2 * a)); //<right> = E/2a<right> 
-	right = right + center;//<right> = E/2a<right> + center 
+		/* Progressive passes, every 8th pixel first, then every 4th, 2nd & the rest. Each pass only casts the pixels
+		 * the earlier ones didn't, and every coarse pass is written out with its gaps filled */
+		for (int step = COARSE_STEP; progressive && step >= 1; step /= 2)
+		{
+			model.render(view.data(), image_ptr.data(), n, step, (step == COARSE_STEP) ? 0 : step * 2);
 
-	//Find top 
-	top = up * (E / 2); //<top> = E/2<up> 
-	top = top + center;//<top> = E/2<up> + <center> 
+			if (step == 1) break; //Last pass is the final image
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			if (!write_views(image_ptr.data(), n, first, filename, batch, "_pass" + std::to_string(step), stream, msg)) return 1;
+			write_time += seconds_since(start);
+		}
 
-	//Find bottom 
-	bottom = up * ((-E) / 2); //<bottom> = -E/2<up> 
-	bottom = bottom + center;//<bottom> = -E/2<up> + <center> 
+		/* Write pixel values to new .ppm files */
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if (!write_views(image_ptr.data(), n, first, filename, batch, "", stream, msg)) return 1;
+		if (aux && !write_aux_views(image_ptr.data(), n, first, filename, batch, msg)) return 1;
+		write_time += seconds_since(start);
+	}
 
-	//Find topleft 
-	top_left = up * (E / 2); //<topleft> = E/2<up> 
-	top_left = top_left + left;//<topleft> = E/2<up> + <left> 
+	//A chunk that couldn't be read leaves a hole in the image
+	if (model.chunks.is_open() && model.chunks.stats().failed > 0)
+	{
+		msg << "Could not read " << model.chunks.stats().failed << " chunk(s) of " << filename << std::endl;
+		return 1;
+	}
 
-	/* Determine each pixel r,c in the image */
-	std::cout << "Rendering..." << std::endl;
-	for (int r = 0; r < ROWS; r++)
+	/* Print where the time went & how much work each ray did */
+	if (stats)
 	{
-		//Go through each column in the row
-		for (int c = 0; c < COLS; c++)
+		double pixels = (double)width * height * count;
+		double render_time = model.times.render;
+		const RayStats& counts = model.counts;
+		fprintf(info, "Stats for %s: %d vertices, %d faces, %d BVH nodes\n", args[0], model.vertices, model.faces,
+			model.chunks.is_open() ? model.chunks.nodes : (int)model.bvh.nodes.size());
+		if (options.precision != PRECISION_FLOAT)
 		{
-			//Calculate vector coordinates for the image pixel
-		    diff = bottom - top; //<diff> = <bottom - top> 
-			diff = diff * ((float)r / (ROWS - 1)); //[r/(ROWS-1)]<bottom - top> 
-			diff1 = right - left; //<diff1> = <right-left>  
-			diff1 = diff1 * ((float)c / (COLS - 1)); //<diff1> = c/(COLS-1)<right-left> 
-			sum = diff1 + diff;//<sum> = c/(COLS-1)<right-left> + r/(ROWS-1)<bottom - top>
-			image = top_left + sum;//<image> = <topleft> + c/(COLS-1)<right-left> + r/(ROWS-1)<bottom - top>  
-
-			//Find the plane equation that contains the triangle 
-			zBuffer = FAR; //Default the zBuffer to far away for each pixel before checking triangles 
-			close_tri = -1; //Default index to impossible value, meant to distinguish if any triangle is found or not
-			for (int i = 0; i < faces; i++)
+			fprintf(info, "  %s precision, vertices relative to %.17g %.17g %.17g\n",
+				(options.precision == PRECISION_LOCAL) ? "local" : "double", model.origin.a, model.origin.b, model.origin.c);
+		}
+		fprintf(info, "  parse       %10.4f s\n", model.times.parse);
+		fprintf(info, "  clean       %10.4f s\n", model.times.clean);
+		fprintf(info, "  bvh build   %10.4f s\n", model.times.bvh);
+		fprintf(info, "  table build %10.4f s\n", model.times.table);
+		fprintf(info, "  render      %10.4f s  (%.4f s per view, %.2f Mpixels/s)\n", render_time, render_time / count,
+			pixels / render_time / 1e6);
+		fprintf(info, "  write       %10.4f s\n", write_time);
+		if (counts.rays > 0)
+		{
+			fprintf(info, "  rays        %10lld    (%.2f Mrays/s)\n", counts.rays, counts.rays / render_time / 1e6);
+			fprintf(info, "  boxes/ray   %10.2f\n", (double)counts.nodes / counts.rays);
+			fprintf(info, "  tests/ray   %10.2f\n", (double)counts.tests / counts.rays);
+			fprintf(info, "  hit rate    %10.2f %%\n", 100.0 * counts.hits / counts.rays);
+			fprintf(info, "  culled      %10.2f %%  (rays in tiles with nothing in their frustum)\n", 100.0 * counts.culled / counts.rays);
+			if (options.aa > 1) fprintf(info, "  refined     %10.2f %%  (edge pixels supersampled)\n", 100.0 * counts.refined / pixels);
+			if (counts.shadows > 0)
 			{
-				//Find v0, v1, v2 for this triangle 
-				v0 = find_vector(V, triangle[i].v0);
-				v1 = find_vector(V, triangle[i].v1);
-				v2 = find_vector(V, triangle[i].v2); 
-
-				//Find ABC
-				diff = v1 - v0; //<diff> = <v1-v0> 
-				diff1 = v2 - v0; //<diff1> = <v2-v0> 
-				ABC = diff.cross(diff1); //<A,B,C> = <v1-v0> x <v2-v0> 
-
-				//Find D 
-				prod1 = ABC * -1; //<prod1> = -<A,B,C>
-				D = v_dot_product(prod1, v0); //D = -<A,B,C> * <v0>
-
-				//Find distance along the image pixel ray to the triangle
-				n = v_dot_product(prod1, camera) - D; //n = -<A,B,C> * camera - D
-				diff = image - camera; //<diff> = <image - camera>
-				d = v_dot_product(ABC, diff); //d = <ABC> * <image - camera> 
-
-				//If ray is parallel to triangle, d near zero, skip
-				if (fabs(d) > 1e-6)
-				{
-					//Find 3D coords <intersect> of ray & plane
-					diff = diff * (n/d); //<diff> = n/d<image-camera> 
-					intersect = camera + diff;//<intersect> = <camera> + n/d<image-camera> 
-
-					/* Determine if intersection point lies within triangle, if any dot product is less than 0 (outside!), stop early */
-
-					//Dot1
-					diff = v2 - v0; //<diff> = <v2-v0> 
-					diff1 = v1 - v0; //<diff1> = <v1-v0> 
-					prod1 = diff.cross(diff1); //<prod1> = <v2-v0> x <v1-v0> 
-					diff = intersect - v0; //<diff> = <intersect-v0> 
-					prod2 = diff.cross(diff1); //<prod2> = <intersect-v0> x <v1-v0>
-					dot1 = v_dot_product(prod1, prod2); //dot1 = 〈v2 − v0〉 × 〈v1 − v0〉 · 〈intersect − v0〉 × 〈v1 − v0〉 
-
-					//Dot2 if previous passes
-					if (dot1 >= 0)
-					{
-						diff = v0 - v1; //<diff> = <v0-v1> 
-						diff1 = v2 - v1; //<diff1> = <v2-v1> 
-						prod1 = diff.cross(diff1); //<prod1> = <v0-v1> x <v2-v1> 
-						diff = intersect - v1; //<diff> = <intersect-v1> 
-						prod2 = diff.cross(diff1); //<prod2> = <intersect-v1> x <v2-v1>
-						dot2 = v_dot_product(prod1, prod2); //dot2 = 〈v0 − v1〉 × 〈v2 − v1〉 · 〈intersect − v1〉 × 〈v2 − v1〉
-					}
-
-					//Dot3 if previous two pass
-					if (dot1 >= 0 && dot2 >= 0)
-					{
-						diff = v1 - v2; //<diff> = <v1-v2> 
-						diff1 = v0 - v2; //<diff1> = <v0-v2> 
-						prod1 = diff.cross(diff1); //<prod1> = <v1-v2> x <v0-v2> 
-						diff = intersect - v2; //<diff> = <intersect-v2> 
-						prod2 = diff.cross(diff1); //<prod2> = <intersect-v2> x <v0-v2>
-						dot3 = v_dot_product(prod1, prod2); //dot3 = 〈v1 − v2〉 × 〈v0 − v2〉 · 〈intersect − v2〉 × 〈v0 − v2〉
-					}
-
-					//Proved all dot products, triangle is "seen" 
-					if (dot1 >= 0 && dot2 >= 0 && dot3 >= 0)
-					{
-						//Check if this triangle is closer than other triangles. If so, set this triangle to be closest 
-						if (n / d < zBuffer)
-						{
-							close_tri = i; //Save triangle index
-							zBuffer = n / d; //Save the distance
-						}
-					}
-				}
+				fprintf(info, "  shadow rays %10lld    (%.2f %% blocked)\n", counts.shadows, 100.0 * counts.occluded / counts.shadows);
 			}
-
-			//Set pixel color depending on triangle found
-			if (close_tri < 0) pixel[r][c] = BLACK; //Triangle not found, set to background color
-			else pixel[r][c] = 155 + (close_tri % 100); //Triangle found, set to greyscale value varied by triangle index 
-			//printf("%d", pixel[r][c]);
 		}
-	}
-
-	/* Handle new file name */
-	std::string newExt = ".ppm";
-	size_t ext_pos = filename.find_last_of('.'); //Find location of file extension in filename
-	if (ext_pos != std::string::npos) filename = filename.substr(0, ext_pos); //Get rid of old extension, if it exists 
-	std::string newfilename = filename + newExt; //New file should be the same name, with new extension
+		if (model.chunks.is_open())
+		{
+			ChunkStats cache = model.chunks.stats();
+			int largest = 0;
+			for (size_t g = 0; g < model.chunks.entry.size(); g++) largest = std::max(largest, model.chunks.entry[g].faces);
+			fprintf(info, "  chunks      %10d    (%d faces in the largest, %d MB cache)\n", (int)model.chunks.entry.size(), largest,
+				options.cache);
+			fprintf(info, "  chunk reads %10lld    (%lld reused, %lld evicted, %.4f s reading)\n", cache.loads, cache.reuses,
+				cache.evictions, cache.read);
+			fprintf(info, "  chunk peak  %10.1f MB (most chunk memory at once)\n", cache.peak / 1048576.0);
+		}
 
-	/* Write pixel values to new .ppm file */
-	std::string newHeader = "P5 256 256 255\n"; 
-	std::ofstream outfile(newfilename, std::ios::binary);
-	outfile.write(newHeader.c_str(), newHeader.size());
-	outfile.write(reinterpret_cast<char*>(&pixel[0][0]), ROWS * COLS * sizeof(unsigned char)); //Expects char, need to convert from unsigned to char
-	outfile.close(); 
-	std::cout << "Outputting to " << newfilename << std::endl;
+		//Peak resident set of the whole process, ru_maxrss is in kilobytes on Linux
+		struct rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) == 0) fprintf(info, "  memory      %10.1f MB (peak resident)\n", usage.ru_maxrss / 1024.0);
+	}
 
 	//Exit
 	return 0;
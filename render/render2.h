@@ -6,46 +6,73 @@
  * Assumptions: User knows that render.c needs this library, and understands datatypes & macros
  */
 
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+
  /* Define macros */
-#define COLS 256 
-#define ROWS 256 
+#define COLS 256 //Default image width
+#define ROWS 256 //Default image height
 #define FLOAT_MAX 3.402823466e+38F 
 #define BLACK 0 
 #define FAR 999999 
 #define PI 3.14159265358979323846
+#define TILE 16 //Width & height of the pixel tiles handed to each thread
+#define WELD_EPS 1e-6f //Default weld distance of --clean, as a fraction of the model size
+#define COARSE_STEP 8 //First progressive pass casts every 8th pixel of every 8th row
+#define AA_MAX 8 //Most strata per side of a supersampled pixel
+#define AA_DEPTH 0.02f //Depth jump between neighbors, as a fraction of the nearer one, that marks an edge
+#define AMBIENT 0.2f //Share of full brightness that faces turned away from the light or in shadow still get
+#define SHADOW_EPS 1e-4f //Shadow rays start this fraction of the model size off the surface
+
+//Shading modes of --shade
+#define SHADE_INDEX 0 //155 + face index % 100, so neighboring faces stand apart & images of both engines can be diffed
+#define SHADE_LAMBERT 1 //Directional light, brighter the more a face turns towards it
+
+//Precision modes of --precision
+#define PRECISION_FLOAT 0 //Vertices, setup & hit tests all in float, as parsed
+#define PRECISION_LOCAL 1 //Parse & set up in double, hit tests in float relative to the center of the model
+#define PRECISION_DOUBLE 2 //Same setup as local, hit tests in double too. Slow, kept as the reference
 
 /* Declare Classes */
 
-//Class holds the vertices of a 3x1 matrix. Works for vertices with floats
-class Vector{ 
+//Class holds the vertices of a 3x1 matrix. T is the scalar type, float for the renderer & double for setup math
+template <typename T>
+class Vec3{ 
 public:
-	float a, b, c; 
+	T a, b, c; 
 
 	/* Constructors */
-	Vector() : a(0.0), b(0.0), c(0.0) {} 
-	Vector(float _a, float _b, float _c) : a(_a), b(_b), c(_c) {} 
+	Vec3() : a(0.0), b(0.0), c(0.0) {} 
+	Vec3(T _a, T _b, T _c) : a(_a), b(_b), c(_c) {} 
+	template <typename S>
+	explicit Vec3(const Vec3<S>& other) : a((T)other.a), b((T)other.b), c((T)other.c) {} //Convert between float & double
 
 	/* Member Functions Declarations */ 
 
 	// Add two 3x1 matrices together. Overload + operator
-	Vector operator+(const Vector& other) const 
+	Vec3 operator+(const Vec3& other) const 
 	{
 		//Go through matrix, add corresponding rows together
-		return Vector(a + other.a, b + other.b, c + other.c);
+		return Vec3(a + other.a, b + other.b, c + other.c);
 	}
 
 	// Subtract two 3x1 matrices together
-	Vector operator-(const Vector& other) const
+	Vec3 operator-(const Vec3& other) const
 	{
 		//Go through matrix, subtract corresponding rows together
-		return Vector(a - other.a, b - other.b, c - other.c);
+		return Vec3(a - other.a, b - other.b, c - other.c);
 	}
 
 	// Multiply a 3x1 matrix by a scalar
-	Vector operator*(float scal) const
+	Vec3 operator*(T scal) const
 	{
 		//Go through matrix, multiply each row by scalar 
-		return Vector(a * scal, b * scal, c * scal);
+		return Vec3(a * scal, b * scal, c * scal);
 	}
 
 	/* Cross Multiply two 3x1 matrices using Algebraic Definition
@@ -53,10 +80,10 @@ public:
 	 * v1: Input 3x1 matrix
 	 * v2: Input 3x1 matrix
 	 */
-	Vector cross(const Vector& other) const
+	Vec3 cross(const Vec3& other) const
 	{
 		//Apply cross product formula 
-		Vector product;
+		Vec3 product;
 		product.a = (b * other.c) - (c * other.b); //v1[y]*v2[z] - v1[z]*v2[y]
 		product.b = (c * other.a) - (a * other.c); //v1[z]*v2[x] - v1[x]*v2[z]
 		product.c = (a * other.b) - (b * other.a); //v1[x]*v2[y] - v1[y]*v2[x] 
@@ -71,6 +98,9 @@ public:
 
 };
 
+typedef Vec3<float> Vector; //What the renderer stores & traces with
+typedef Vec3<double> DVector; //Parsing & camera setup of --precision local & double
+
 //Class holds the faces of a 3x1 matrix. Meant to store triangle points
 class Face { 
 public:
@@ -86,11 +116,117 @@ public:
 	}
 };
 
-/* Function Declarations */ 
-float find_e(Vector max, Vector min); //Find E scalar
-void create_rotate(float R[3][3], float R1[3][3], float R2[3][3]); //Create the 3x3 rotation matrix for XYZ plane
-void v_rotate(Vector product, float R[3][3], Vector V); //Apply rotation onto given 3x1 vector
-void rotate(Vector cam, Vector up, float X, float Y, float Z); //Handle rotation of camera & up vector
-float v_dot_product(Vector v1, Vector v2); //Dot Product two 3x1 vectors
+//Class holds the camera & the 3D coordinates bounding the image, everything a pixel ray needs
+template <typename T>
+class ViewT {
+public:
+	Vec3<T> camera; //Origin of every pixel ray
+	Vec3<T> left, right, top, bottom, top_left; //Edges & corner of the image plane
+	int col_span, row_span; //Pixel steps across the image, COLS-1 & ROWS-1 for the default size
+
+	ViewT() : col_span(1), row_span(1) {}
+	template <typename S>
+	explicit ViewT(const ViewT<S>& other) : camera(other.camera), left(other.left), right(other.right), top(other.top),
+		bottom(other.bottom), top_left(other.top_left), col_span(other.col_span), row_span(other.row_span) {} //Round a double setup
+};
+
+typedef ViewT<float> View;
+
+//Class holds the output image on the heap, rows are stored one after another. Aligned so tiles start on cache lines
+class Framebuffer {
+public:
+	int width, height; //Image size in pixels
+	unsigned char* pixel; //width * height greyscale values, row by row
+	float* depth; //Distance from the camera to the hit of every pixel, INFINITY for background. NULL unless asked for
+	int* id; //Face index seen by every pixel, -1 for background. NULL unless asked for
+	unsigned char* normal; //Face normal of every pixel as R,G,B = 127.5(N + 1), 0,0,0 for background. NULL unless asked for
+
+	/* Constructors */
+	Framebuffer(int w, int h) : width(w), height(h), depth(NULL), id(NULL), normal(NULL)
+	{
+		pixel = (unsigned char*)plane(1);
+		memset(pixel, BLACK, (size_t)w * h);
+	}
+	~Framebuffer()
+	{
+		free(pixel);
+		free(depth);
+		free(id);
+		free(normal);
+	}
+	Framebuffer(const Framebuffer&) = delete; //Owns its memory, no copies
+	Framebuffer& operator=(const Framebuffer&) = delete;
+
+	/* Member Functions Declarations */
+	unsigned char* row(int r) { return pixel + (size_t)r * width; } //First pixel of row r
+	const unsigned char* row(int r) const { return pixel + (size_t)r * width; }
+
+	/* Allocate the extra buffers filled next to the grey image, in the same pass
+	 * want_depth: 1 for the depth buffer
+	 * want_id: 1 for the face index buffer
+	 * want_normal: 1 for the normal buffer
+	 */
+	void add_aux(int want_depth, int want_id, int want_normal)
+	{
+		if (want_depth && depth == NULL) depth = (float*)plane(sizeof(float));
+		if (want_id && id == NULL) id = (int*)plane(sizeof(int));
+		if (want_normal && normal == NULL) normal = (unsigned char*)plane(3);
+	}
+
+	/* Free extra buffers a renderer only needed while it worked
+	 * drop_depth: 1 to free the depth buffer
+	 * drop_id: 1 to free the face index buffer
+	 * drop_normal: 1 to free the normal buffer
+	 */
+	void drop_aux(int drop_depth, int drop_id, int drop_normal)
+	{
+		if (drop_depth)
+		{
+			free(depth);
+			depth = NULL;
+		}
+		if (drop_id)
+		{
+			free(id);
+			id = NULL;
+		}
+		if (drop_normal)
+		{
+			free(normal);
+			normal = NULL;
+		}
+	}
+
+private:
+	/* 64 byte aligned memory for one value of the given size per pixel */
+	void* plane(size_t size)
+	{
+		size_t bytes = ((size_t)width * height * size + 63) / 64 * 64; //aligned_alloc wants a multiple of the alignment
+		void* memory = std::aligned_alloc(64, bytes);
+		if (memory == NULL) throw std::bad_alloc();
+		return memory;
+	}
+};
+
+/* Dot Multiply two 3x1 matrices
+ * v1: Input 3x1 matrix
+ * v2: Input 3x1 matrix
+ * Return product: Result of the dot multiplication (Scalar)
+ */
+template <typename T>
+inline T v_dot_product(const Vec3<T>& v1, const Vec3<T>& v2)
+{
+	return (v1.a * v2.a) + (v1.b * v2.b) + (v1.c * v2.c);
+}
+
+/* Function Declarations, templates are built for float & double in render2.cpp */ 
+template <typename T> T find_e(Vec3<T> max, Vec3<T> min); //Find E scalar
+template <typename T> void create_rotate(T R[3][3], T R1[3][3], T R2[3][3]); //Create the 3x3 rotation matrix for XYZ plane
+template <typename T> void v_rotate(Vec3<T>& product, T R[3][3], Vec3<T> V); //Apply rotation onto given 3x1 vector
+template <typename T> void rotate(Vec3<T>& cam, Vec3<T>& up, T X, T Y, T Z); //Handle rotation of camera & up vector
 Vector find_vector(const std::vector<Vector>& table, int index); //Find vertices for given point on triangle
-#pragma once
+template <typename T> void make_view(ViewT<T>& view, Vec3<T> center, T E, T X, T Y, T Z, int width,
+	int height); //Set up camera & image plane
+int write_ppm(const std::string& filename, const Framebuffer& image); //Write image to a binary .ppm file
+int write_ppm(std::ostream& out, const Framebuffer& image); //Write image as a binary .ppm to an open stream
+int write_aux(const std::string& base, const Framebuffer& image); //Write the depth, face index & normal buffers that were asked for
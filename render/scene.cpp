@@ -0,0 +1,236 @@
+/* scene.cpp
+ * Binary Scene
+ *
+ * Purpose: To write & map .rscene files. A file is a fixed header followed by sections, each one array of the
+ *          renderer stored exactly as it sits in memory:
+ *            vertices, faces, source index of each face,
+ *            BVH nodes, BVH index, table ids & the 9 corner arrays of the table (only when the BVH is saved)
+ *
+ * Assumptions: Vector, Face & BVHNode are plain structs of 4 byte fields, checked at compile time
+ */
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <climits>
+#include "render2.h"
+#include "bvh.h"
+#include "tri_table.h"
+#include "mapped_file.h"
+#include "scene.h"
+
+#define SCENE_MAGIC "RSCENE\r\n" //First 8 bytes of every file, the CR LF catches text mode mangling
+#define SCENE_HAS_BVH 1 //Header flag, BVH & table sections are present
+
+//Sections in file order
+#define SECTION_VERTEX 0
+#define SECTION_FACE 1
+#define SECTION_SOURCE 2
+#define SECTION_NODE 3
+#define SECTION_INDEX 4
+#define SECTION_ID 5
+#define SECTION_CORNER 6 //9 sections, v0 x y z, v1 x y z, v2 x y z
+#define SECTIONS 15
+
+static_assert(sizeof(Vector) == 12 && sizeof(Face) == 12 && sizeof(BVHNode) == 32, "scene sections are stored as they sit in memory");
+
+//Class holds the start of every .rscene file
+class SceneHeader {
+public:
+	char magic[8]; //SCENE_MAGIC
+	uint32_t version; //SCENE_VERSION
+	uint32_t flags; //SCENE_HAS_BVH or 0
+	uint64_t vertices, faces, nodes, slots; //Element counts, table sections hold slots + TRI_LANES padding entries
+	float min[3], max[3]; //Bounding box of the vertices, so loading never has to read every vertex
+	uint64_t offset[SECTIONS]; //Byte offset of each section, 0 if it isn't in the file
+	uint64_t bytes[SECTIONS]; //Byte size of each section
+};
+
+/* Write one section at the next aligned offset
+ * out: File being written
+ * header: Offset & size of the section are recorded here
+ * section: Which section is written
+ * data: First byte of the array
+ * bytes: Size of the array
+ * pos: Current end of the file, moved past the section
+ */
+static void write_section(std::ofstream& out, SceneHeader& header, int section, const void* data, size_t bytes, uint64_t& pos)
+{
+	static const char zero[SCENE_ALIGN] = { 0 };
+	uint64_t pad = (SCENE_ALIGN - pos % SCENE_ALIGN) % SCENE_ALIGN;
+	out.write(zero, pad);
+	pos += pad;
+
+	header.offset[section] = pos;
+	header.bytes[section] = bytes;
+	if (bytes > 0) out.write((const char*)data, bytes);
+	pos += bytes;
+}
+
+/* Write a mesh & (if given) its BVH & triangle table to a .rscene file
+ * filename: Name of the new file
+ * V: Vertices of the mesh
+ * triangle: Faces of the mesh
+ * source: Index in the .ply file of every face
+ * bvh: BVH built over the faces, NULL to leave it out
+ * table: Triangle table built in BVH order, NULL to leave it out
+ * min: Bounding box minimum of the vertices
+ * max: Bounding box maximum of the vertices
+ * error: Output reason the file couldn't be written
+ * Return 1 on success, 0 on failure
+ */
+int save_scene(const std::string& filename, const std::vector<Vector>& V, const std::vector<Face>& triangle,
+	const std::vector<int>& source, const BVH* bvh, const TriTable* table, Vector min, Vector max, std::string& error)
+{
+	std::ofstream out(filename, std::ios::binary);
+	if (!out.is_open())
+	{
+		error = "Could not create " + filename;
+		return 0;
+	}
+
+	SceneHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SCENE_MAGIC, 8);
+	header.version = SCENE_VERSION;
+	header.flags = (bvh != NULL && table != NULL) ? SCENE_HAS_BVH : 0;
+	header.vertices = V.size();
+	header.faces = triangle.size();
+	header.min[0] = min.a; header.min[1] = min.b; header.min[2] = min.c;
+	header.max[0] = max.a; header.max[1] = max.b; header.max[2] = max.c;
+
+	//Header is written twice, first to hold the space & again once the offsets are known
+	uint64_t pos = sizeof(header);
+	out.write((const char*)&header, sizeof(header));
+	write_section(out, header, SECTION_VERTEX, V.data(), V.size() * sizeof(Vector), pos);
+	write_section(out, header, SECTION_FACE, triangle.data(), triangle.size() * sizeof(Face), pos);
+	write_section(out, header, SECTION_SOURCE, source.data(), source.size() * sizeof(int), pos);
+	if (header.flags & SCENE_HAS_BVH)
+	{
+		header.nodes = bvh->nodes.size();
+		header.slots = table->count;
+		write_section(out, header, SECTION_NODE, bvh->nodes.data(), bvh->nodes.size() * sizeof(BVHNode), pos);
+		write_section(out, header, SECTION_INDEX, bvh->index.data(), bvh->index.size() * sizeof(int), pos);
+		write_section(out, header, SECTION_ID, table->id.data(), table->id.size() * sizeof(int), pos);
+		const Array<float>* corner[3] = { table->v0, table->v1, table->v2 };
+		for (int k = 0; k < 9; k++)
+		{
+			const Array<float>& axis = corner[k / 3][k % 3];
+			write_section(out, header, SECTION_CORNER + k, axis.data(), axis.size() * sizeof(float), pos);
+		}
+	}
+
+	out.seekp(0);
+	out.write((const char*)&header, sizeof(header));
+	out.close();
+	if (!out.good())
+	{
+		error = "Could not write " + filename;
+		return 0;
+	}
+	return 1;
+}
+
+/* Map a .rscene file. The BVH & table borrow their arrays from the mapping, nothing is copied
+ * filename: File to open
+ * file: Output mapping, must stay open while the BVH & table are used
+ * info: Output counts & bounding box
+ * bvh: Output BVH, left empty if the file has none
+ * table: Output triangle table, left empty if the file has none
+ * error: Output reason the file couldn't be loaded
+ * Return 1 on success, 0 on failure
+ */
+int load_scene(const std::string& filename, MappedFile& file, SceneInfo& info, BVH& bvh, TriTable& table, std::string& error)
+{
+	if (!file.open(filename, 0))
+	{
+		error = "Could not open " + filename;
+		return 0;
+	}
+	if (file.size < sizeof(SceneHeader) || memcmp(file.data, SCENE_MAGIC, 8) != 0)
+	{
+		error = filename + " is not an .rscene file";
+		return 0;
+	}
+
+	const SceneHeader* header = (const SceneHeader*)file.data;
+	if (header->version != SCENE_VERSION)
+	{
+		error = filename + " was written by a different version of render2, export it again";
+		return 0;
+	}
+
+	//Every section must be inside the file, aligned & hold as many entries as the header says
+	uint64_t table_size = header->slots + TRI_LANES;
+	const uint64_t expect[SECTIONS] = { header->vertices * sizeof(Vector), header->faces * sizeof(Face), header->faces * sizeof(int),
+		header->nodes * sizeof(BVHNode), header->slots * sizeof(int), table_size * sizeof(int),
+		table_size * sizeof(float), table_size * sizeof(float), table_size * sizeof(float),
+		table_size * sizeof(float), table_size * sizeof(float), table_size * sizeof(float),
+		table_size * sizeof(float), table_size * sizeof(float), table_size * sizeof(float) };
+	int sections = (header->flags & SCENE_HAS_BVH) ? SECTIONS : SECTION_NODE;
+	for (int k = 0; k < sections; k++)
+	{
+		if (header->bytes[k] != expect[k] || header->offset[k] % SCENE_ALIGN != 0 || header->offset[k] > file.size
+			|| header->bytes[k] > file.size - header->offset[k])
+		{
+			error = filename + " is truncated or damaged";
+			return 0;
+		}
+	}
+
+	//Faces are copied out for the rasterizer & mesh stages, every corner must be one of the vertices
+	const Face* face = (const Face*)(file.data + header->offset[SECTION_FACE]);
+	for (uint64_t i = 0; i < header->faces; i++)
+	{
+		if ((uint64_t)face[i].v0 >= header->vertices || (uint64_t)face[i].v1 >= header->vertices
+			|| (uint64_t)face[i].v2 >= header->vertices)
+		{
+			error = filename + " is truncated or damaged";
+			return 0;
+		}
+	}
+
+	info.vertices = (int)header->vertices;
+	info.faces = (int)header->faces;
+	info.has_bvh = (header->flags & SCENE_HAS_BVH) ? 1 : 0;
+	info.min = Vector(header->min[0], header->min[1], header->min[2]);
+	info.max = Vector(header->max[0], header->max[1], header->max[2]);
+	if (!info.has_bvh) return 1;
+
+	bvh.nodes.borrow((const BVHNode*)(file.data + header->offset[SECTION_NODE]), header->nodes);
+	if (header->slots > INT_MAX || !bvh.check((int)header->slots))
+	{
+		bvh.nodes.release();
+		error = filename + " is truncated or damaged";
+		return 0;
+	}
+	bvh.index.borrow((const int*)(file.data + header->offset[SECTION_INDEX]), header->slots);
+	table.count = (int)header->slots;
+	table.id.borrow((const int*)(file.data + header->offset[SECTION_ID]), table_size);
+	Array<float>* corner[3] = { table.v0, table.v1, table.v2 };
+	for (int k = 0; k < 9; k++)
+	{
+		corner[k / 3][k % 3].borrow((const float*)(file.data + header->offset[SECTION_CORNER + k]), table_size);
+	}
+	return 1;
+}
+
+/* Copy the mesh out of a mapped .rscene file, for the stages that work on the mesh itself (rasterizer, cleanup, export)
+ * file: Mapping opened by load_scene()
+ * V: Output vertices
+ * triangle: Output faces
+ * source: Output index in the .ply file of every face
+ */
+void scene_mesh(const MappedFile& file, std::vector<Vector>& V, std::vector<Face>& triangle, std::vector<int>& source)
+{
+	const SceneHeader* header = (const SceneHeader*)file.data;
+	const Vector* vertex = (const Vector*)(file.data + header->offset[SECTION_VERTEX]);
+	const Face* face = (const Face*)(file.data + header->offset[SECTION_FACE]);
+	const int* index = (const int*)(file.data + header->offset[SECTION_SOURCE]);
+
+	V.assign(vertex, vertex + header->vertices);
+	triangle.assign(face, face + header->faces);
+	source.assign(index, index + header->faces);
+}
@@ -0,0 +1,44 @@
+/* scene.h
+ * Binary Scene Library
+ *
+ * Purpose: To save a parsed (and cleaned) mesh together with its BVH & triangle table as one .rscene file,
+ *          and to load it back by mapping the file. The BVH & table point straight into the mapping, so a loaded
+ *          scene renders without parsing, building or copying anything
+ *
+ * Assumptions: Files are read on a machine with the same byte order & float format that wrote them.
+ *              Every section starts on a SCENE_ALIGN byte boundary of the file, and mmap returns page aligned memory
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "render2.h"
+#include "bvh.h"
+#include "tri_table.h"
+#include "mapped_file.h"
+
+#define SCENE_ALIGN 64 //Byte alignment of every section, one cache line & enough for any SIMD load
+#define SCENE_VERSION 1 //Bumped whenever the layout changes, older files are refused
+
+/* Declare Classes */
+
+//Class holds what an .rscene file says about itself
+class SceneInfo {
+public:
+	int vertices; //Number of vertices
+	int faces; //Number of faces
+	int has_bvh; //1 if the BVH & triangle table are in the file
+	Vector min, max; //Bounding box of the vertices
+
+	SceneInfo() : vertices(0), faces(0), has_bvh(0) {}
+};
+
+/* Function Declarations */
+int save_scene(const std::string& filename, const std::vector<Vector>& V, const std::vector<Face>& triangle,
+	const std::vector<int>& source, const BVH* bvh, const TriTable* table, Vector min, Vector max,
+	std::string& error); //Write a .rscene file, BVH & table are left out when NULL. Return 1 on success
+int load_scene(const std::string& filename, MappedFile& file, SceneInfo& info, BVH& bvh, TriTable& table,
+	std::string& error); //Map a .rscene file, BVH & table borrow the mapping. Return 1 on success
+void scene_mesh(const MappedFile& file, std::vector<Vector>& V, std::vector<Face>& triangle,
+	std::vector<int>& source); //Copy the mesh out of a mapped .rscene file
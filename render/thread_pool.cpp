@@ -0,0 +1,145 @@
+/* thread_pool.cpp
+ * Work Stealing Thread Pool
+ *
+ * Purpose: To run independent jobs across every core. Jobs are dealt out in contiguous blocks so neighbouring tiles
+ *          stay on one thread, and idle threads steal from the back of busy queues
+ *
+ * Assumptions: run() is only called from one thread at a time
+ */
+
+#include "thread_pool.h"
+
+/* Start the worker threads
+ * threads: Number of threads including the caller of run(), 0 or less uses every core
+ */
+ThreadPool::ThreadPool(int threads) : work(NULL), pending(0), generation(0), stop(false)
+{
+	if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+	if (threads <= 0) threads = 1; //hardware_concurrency() may not know
+
+	for (int i = 0; i < threads; i++) queue.push_back(std::unique_ptr<JobQueue>(new JobQueue()));
+	for (int i = 1; i < threads; i++) workers.push_back(std::thread(&ThreadPool::worker_loop, this, i));
+}
+
+/* Tell every worker to stop, then wait for them to exit */
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stop = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+}
+
+/* Pop a job from own queue, otherwise steal from the back of another queue
+ * id: Thread asking for a job
+ * job: Output job number
+ * Return 1 if a job was found, 0 if every queue is empty
+ */
+int ThreadPool::take(int id, int& job)
+{
+	int threads = size();
+
+	//Own queue first, front keeps neighbouring tiles together
+	{
+		JobQueue& own = *queue[id];
+		std::lock_guard<std::mutex> guard(own.lock);
+		if (!own.jobs.empty())
+		{
+			job = own.jobs.front();
+			own.jobs.pop_front();
+			return 1;
+		}
+	}
+
+	//Steal, starting at the next thread so thieves spread out
+	for (int i = 1; i < threads; i++)
+	{
+		JobQueue& other = *queue[(id + i) % threads];
+		std::lock_guard<std::mutex> guard(other.lock);
+		if (!other.jobs.empty())
+		{
+			job = other.jobs.back();
+			other.jobs.pop_back();
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Keep running jobs until none are left anywhere
+ * id: Thread doing the work
+ */
+void ThreadPool::drain(int id)
+{
+	int job;
+	while (take(id, job))
+	{
+		(*work)(job);
+
+		//Last job wakes up run()
+		std::lock_guard<std::mutex> guard(lock);
+		if (--pending == 0) done.notify_one();
+	}
+}
+
+/* Body of each worker, sleeps until run() hands out new jobs
+ * id: Thread number, also the index of its queue
+ */
+void ThreadPool::worker_loop(int id)
+{
+	long seen = 0;
+	while (1)
+	{
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [&] { return stop || generation != seen; });
+			if (stop) return;
+			seen = generation;
+		}
+		drain(id);
+	}
+}
+
+/* Run every job once across all threads, returns when the last one finishes
+ * jobs: Number of jobs, work_fn is called with 0..jobs-1
+ * work_fn: Job function, must be safe to call from several threads at once
+ */
+void ThreadPool::run(int jobs, const std::function<void(int)>& work_fn)
+{
+	int threads = size();
+	if (jobs <= 0) return;
+
+	//Single thread, no need for queues
+	if (threads == 1)
+	{
+		for (int j = 0; j < jobs; j++) work_fn(j);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		work = &work_fn;
+		pending = jobs;
+	}
+
+	//Deal jobs out in contiguous blocks, one block per thread
+	for (int t = 0; t < threads; t++)
+	{
+		std::lock_guard<std::mutex> guard(queue[t]->lock);
+		for (int j = (int)((long)jobs * t / threads); j < (int)((long)jobs * (t + 1) / threads); j++) queue[t]->jobs.push_back(j);
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		generation++;
+	}
+	wake.notify_all();
+
+	//Caller works as thread 0, then waits for stragglers
+	drain(0);
+	std::unique_lock<std::mutex> guard(lock);
+	done.wait(guard, [&] { return pending == 0; });
+	work = NULL;
+}
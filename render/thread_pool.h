@@ -0,0 +1,53 @@
+/* thread_pool.h
+ * Work Stealing Thread Pool Library
+ *
+ * Purpose: To spread independent jobs (pixel tiles) over every core. Each thread has its own queue of jobs,
+ *          and steals from the other queues once its own runs dry, so uneven tiles still keep every core busy
+ *
+ * Assumptions: Jobs are independent of each other and can run in any order on any thread
+ */
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <memory>
+
+/* Declare Classes */
+
+//Class holds a fixed set of worker threads. The thread calling run() works too, so a pool of 1 runs everything in place
+class ThreadPool {
+public:
+	/* Constructors */
+	ThreadPool(int threads); //Number of threads, 0 or less uses every core
+	~ThreadPool();
+
+	/* Member Functions Declarations */
+	void run(int jobs, const std::function<void(int)>& work_fn); //Call work_fn(0..jobs-1) across all threads, returns when every job is done
+	int size() const { return (int)queue.size(); } //Number of threads, including the caller
+
+private:
+	//Job queue owned by one thread. Owner pops from the front, thieves take from the back
+	struct JobQueue {
+		std::mutex lock;
+		std::deque<int> jobs;
+	};
+
+	std::vector<std::unique_ptr<JobQueue>> queue; //One queue per thread, queue[0] belongs to the caller of run()
+	std::vector<std::thread> workers; //Threads 1..size-1
+	const std::function<void(int)>* work; //Job function of the current run()
+	std::mutex lock; //Guards everything below
+	std::condition_variable wake; //Signals workers that a new run() started, or that the pool is closing
+	std::condition_variable done; //Signals run() that the last job finished
+	int pending; //Jobs not finished yet in the current run()
+	long generation; //Counts run() calls, so workers know when new jobs arrived
+	bool stop; //Set by the destructor to end the workers
+
+	void worker_loop(int id); //Body of each worker thread
+	void drain(int id); //Run jobs from own queue, then steal until every queue is empty
+	int take(int id, int& job); //Pop a job from own queue or steal one, return 0 if every queue is empty
+};
@@ -0,0 +1,224 @@
+/* tri_kernel.cpp
+ * Triangle Intersection Kernels
+ *
+ * Purpose: To test a ray against a whole BVH leaf at once. AVX2 tests 8 triangles per step, SSE tests 4,
+ *          and the scalar loop is kept for CPUs without either. The best kernel is picked at runtime
+ *
+ * Assumptions: TriTable arrays are padded by TRI_LANES zero slots, so a full vector load past the last triangle is safe.
+ *              Every kernel does the same float operations in the same order, so all of them find the same triangle
+ */
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include "render2.h"
+#include "tri_table.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86 1
+#else
+#define HAVE_X86 0
+#endif
+
+/* Keep a hit if it is closer than the current one. Equal distance goes to the lower face index, same as the brute force loop
+ * table: Precomputed triangles, for the face index of each slot
+ * dist: Distance of the new hit
+ * slot: Table slot of the new hit
+ * zBuffer: Closest distance so far, updated in place
+ * close_slot: Slot of the closest face so far, updated in place
+ */
+static inline void keep_closest(const TriTable& table, float dist, int slot, float& zBuffer, int& close_slot)
+{
+	if (dist < zBuffer || (dist == zBuffer && close_slot >= 0 && table.id[slot] < table.id[close_slot]))
+	{
+		zBuffer = dist;
+		close_slot = slot;
+	}
+}
+
+/* Scalar kernel, one triangle at a time with early outs
+ * table: Precomputed triangles
+ * first: First slot of the leaf
+ * count: Number of slots in the leaf
+ * ray: Ray set up by TriRay
+ * zBuffer: Closest distance so far, updated in place
+ * close_slot: Slot of the closest face so far, updated in place
+ */
+static void leaf_scalar(const TriTable& table, int first, int count, const TriRay& ray, float& zBuffer, int& close_slot)
+{
+	float t;
+	for (int i = first; i < first + count; i++)
+	{
+		if (table.hit(i, ray, t)) keep_closest(table, t, i, zBuffer, close_slot);
+	}
+}
+
+/* Double kernel, the scalar loop with the ray & corners widened to double. Same parameters as leaf_scalar().
+ * The float table is exact in double, so only the test itself gains precision. Distances are rounded back to the float zBuffer
+ */
+static void leaf_double(const TriTable& table, int first, int count, const TriRay& ray, float& zBuffer, int& close_slot)
+{
+	TriRayT<double> wide(ray);
+	double t;
+	for (int i = first; i < first + count; i++)
+	{
+		if (table.hit(i, wide, t)) keep_closest(table, (float)t, i, zBuffer, close_slot);
+	}
+}
+
+#if HAVE_X86
+
+/* SSE kernel, 4 triangles per step. SSE2 is part of every x86-64 CPU, same parameters as leaf_scalar() */
+static void leaf_sse(const TriTable& table, int first, int count, const TriRay& ray, float& zBuffer, int& close_slot)
+{
+	const __m128 ox = _mm_set1_ps(ray.cx), oy = _mm_set1_ps(ray.cy), oz = _mm_set1_ps(ray.cz);
+	const __m128 sx = _mm_set1_ps(ray.sx), sy = _mm_set1_ps(ray.sy), sz = _mm_set1_ps(ray.sz);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	const float *x0 = table.v0[ray.kx].data(), *y0 = table.v0[ray.ky].data(), *z0 = table.v0[ray.kz].data();
+	const float *x1 = table.v1[ray.kx].data(), *y1 = table.v1[ray.ky].data(), *z1 = table.v1[ray.kz].data();
+	const float *x2 = table.v2[ray.kx].data(), *y2 = table.v2[ray.ky].data(), *z2 = table.v2[ray.kz].data();
+	float dist[4];
+
+	for (int base = first; base < first + count; base += 4)
+	{
+		//Corners relative to the camera, sheared so the ray is the z axis
+		__m128 az = _mm_sub_ps(_mm_loadu_ps(z0 + base), oz);
+		__m128 bz = _mm_sub_ps(_mm_loadu_ps(z1 + base), oz);
+		__m128 cz = _mm_sub_ps(_mm_loadu_ps(z2 + base), oz);
+		__m128 ax = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(x0 + base), ox), _mm_mul_ps(sx, az));
+		__m128 ay = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(y0 + base), oy), _mm_mul_ps(sy, az));
+		__m128 bx = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(x1 + base), ox), _mm_mul_ps(sx, bz));
+		__m128 by = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(y1 + base), oy), _mm_mul_ps(sy, bz));
+		__m128 cx = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(x2 + base), ox), _mm_mul_ps(sx, cz));
+		__m128 cy = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(y2 + base), oy), _mm_mul_ps(sy, cz));
+
+		//Edge functions must all be >= 0, or all <= 0 when back faces are kept
+		__m128 U = _mm_sub_ps(_mm_mul_ps(cx, by), _mm_mul_ps(cy, bx));
+		__m128 V = _mm_sub_ps(_mm_mul_ps(ax, cy), _mm_mul_ps(ay, cx));
+		__m128 W = _mm_sub_ps(_mm_mul_ps(bx, ay), _mm_mul_ps(by, ax));
+		__m128 ok = _mm_cmpge_ps(_mm_min_ps(_mm_min_ps(U, V), W), zero);
+		if (!table.cull) ok = _mm_or_ps(ok, _mm_cmple_ps(_mm_max_ps(_mm_max_ps(U, V), W), zero));
+
+		//Drop lanes past the end of the leaf, stop here if the ray misses every triangle
+		int mask = _mm_movemask_ps(ok);
+		int lanes = first + count - base;
+		if (lanes < 4) mask &= (1 << lanes) - 1;
+		if (mask == 0) continue;
+
+		//Not edge on, and in front of the camera: T has the same sign as det
+		__m128 det = _mm_add_ps(_mm_add_ps(U, V), W);
+		__m128 T = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(U, az), _mm_mul_ps(V, bz)), _mm_mul_ps(W, cz)), sz);
+		mask &= _mm_movemask_ps(_mm_and_ps(_mm_cmpneq_ps(det, zero), _mm_cmpgt_ps(_mm_xor_ps(T, _mm_and_ps(det, sign)), zero)));
+		if (mask == 0) continue;
+
+		//Divide only for the lanes that are left, then keep the closest
+		_mm_storeu_ps(dist, _mm_div_ps(T, det));
+		for (int k = 0; k < 4; k++)
+		{
+			if (mask & (1 << k)) keep_closest(table, dist[k], base + k, zBuffer, close_slot);
+		}
+	}
+}
+
+/* AVX2 kernel, 8 triangles per step. Only called after the CPU says it has AVX2, same parameters as leaf_scalar() */
+__attribute__((target("avx2")))
+static void leaf_avx2(const TriTable& table, int first, int count, const TriRay& ray, float& zBuffer, int& close_slot)
+{
+	const __m256 ox = _mm256_set1_ps(ray.cx), oy = _mm256_set1_ps(ray.cy), oz = _mm256_set1_ps(ray.cz);
+	const __m256 sx = _mm256_set1_ps(ray.sx), sy = _mm256_set1_ps(ray.sy), sz = _mm256_set1_ps(ray.sz);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 sign = _mm256_set1_ps(-0.0f);
+	const float *x0 = table.v0[ray.kx].data(), *y0 = table.v0[ray.ky].data(), *z0 = table.v0[ray.kz].data();
+	const float *x1 = table.v1[ray.kx].data(), *y1 = table.v1[ray.ky].data(), *z1 = table.v1[ray.kz].data();
+	const float *x2 = table.v2[ray.kx].data(), *y2 = table.v2[ray.ky].data(), *z2 = table.v2[ray.kz].data();
+	float dist[8];
+
+	for (int base = first; base < first + count; base += 8)
+	{
+		//Corners relative to the camera, sheared so the ray is the z axis
+		__m256 az = _mm256_sub_ps(_mm256_loadu_ps(z0 + base), oz);
+		__m256 bz = _mm256_sub_ps(_mm256_loadu_ps(z1 + base), oz);
+		__m256 cz = _mm256_sub_ps(_mm256_loadu_ps(z2 + base), oz);
+		__m256 ax = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(x0 + base), ox), _mm256_mul_ps(sx, az));
+		__m256 ay = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(y0 + base), oy), _mm256_mul_ps(sy, az));
+		__m256 bx = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(x1 + base), ox), _mm256_mul_ps(sx, bz));
+		__m256 by = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(y1 + base), oy), _mm256_mul_ps(sy, bz));
+		__m256 cx = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(x2 + base), ox), _mm256_mul_ps(sx, cz));
+		__m256 cy = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(y2 + base), oy), _mm256_mul_ps(sy, cz));
+
+		//Edge functions must all be >= 0, or all <= 0 when back faces are kept
+		__m256 U = _mm256_sub_ps(_mm256_mul_ps(cx, by), _mm256_mul_ps(cy, bx));
+		__m256 V = _mm256_sub_ps(_mm256_mul_ps(ax, cy), _mm256_mul_ps(ay, cx));
+		__m256 W = _mm256_sub_ps(_mm256_mul_ps(bx, ay), _mm256_mul_ps(by, ax));
+		__m256 ok = _mm256_cmp_ps(_mm256_min_ps(_mm256_min_ps(U, V), W), zero, _CMP_GE_OQ);
+		if (!table.cull) ok = _mm256_or_ps(ok, _mm256_cmp_ps(_mm256_max_ps(_mm256_max_ps(U, V), W), zero, _CMP_LE_OQ));
+
+		//Drop lanes past the end of the leaf, stop here if the ray misses every triangle
+		int mask = _mm256_movemask_ps(ok);
+		int lanes = first + count - base;
+		if (lanes < 8) mask &= (1 << lanes) - 1;
+		if (mask == 0) continue;
+
+		//Not edge on, and in front of the camera: T has the same sign as det
+		__m256 det = _mm256_add_ps(_mm256_add_ps(U, V), W);
+		__m256 T = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(U, az), _mm256_mul_ps(V, bz)), _mm256_mul_ps(W, cz)), sz);
+		mask &= _mm256_movemask_ps(_mm256_and_ps(_mm256_cmp_ps(det, zero, _CMP_NEQ_OQ), _mm256_cmp_ps(_mm256_xor_ps(T, _mm256_and_ps(det, sign)), zero, _CMP_GT_OQ)));
+		if (mask == 0) continue;
+
+		//Divide only for the lanes that are left, then keep the closest
+		_mm256_storeu_ps(dist, _mm256_div_ps(T, det));
+		for (int k = 0; k < 8; k++)
+		{
+			if (mask & (1 << k)) keep_closest(table, dist[k], base + k, zBuffer, close_slot);
+		}
+	}
+}
+
+#endif
+
+/* Find the fastest kernel this CPU can run */
+int kernel_detect()
+{
+#if HAVE_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return KERNEL_AVX2;
+	if (__builtin_cpu_supports("sse2")) return KERNEL_SSE;
+#endif
+	return KERNEL_SCALAR;
+}
+
+/* Name of a kernel, for printing
+ * kernel: KERNEL_SCALAR, KERNEL_SSE, KERNEL_AVX2 or KERNEL_DOUBLE
+ */
+const char* kernel_name(int kernel)
+{
+	if (kernel == KERNEL_DOUBLE) return "double";
+	if (kernel == KERNEL_AVX2) return "avx2";
+	if (kernel == KERNEL_SSE) return "sse";
+	return "scalar";
+}
+
+/* Choose which kernel hit_leaf() uses. Asking for a kernel the CPU can't run falls back to the best one it can
+ * kernel: KERNEL_SCALAR, KERNEL_SSE, KERNEL_AVX2, KERNEL_DOUBLE or KERNEL_AUTO
+ * Return the kernel actually chosen
+ */
+int TriTable::set_kernel(int kernel)
+{
+	if (kernel == KERNEL_DOUBLE)
+	{
+		leaf = leaf_double;
+		return kernel;
+	}
+
+	int best = kernel_detect();
+	if (kernel == KERNEL_AUTO || kernel > best) kernel = best;
+
+	leaf = leaf_scalar;
+#if HAVE_X86
+	if (kernel == KERNEL_SSE) leaf = leaf_sse;
+	if (kernel == KERNEL_AVX2) leaf = leaf_avx2;
+#endif
+	return kernel;
+}
@@ -0,0 +1,48 @@
+/* tri_table.cpp
+ * Triangle Table
+ *
+ * Purpose: To copy each face's corners into the table once, before rendering starts
+ *
+ * Assumptions: Faces index valid vertices. Kernels that read the table live in tri_kernel.cpp
+ */
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include "render2.h"
+#include "tri_table.h"
+
+/* Fill the table with every triangle, slot i holds face order[i]
+ * V: Table that stores all vertices from .ply file
+ * triangle: Table that stores all faces from .ply file
+ * order: Face index for every slot, normally BVH::index
+ * source: Index in the .ply file of every face, kept as the slot's id
+ */
+void TriTable::build(const std::vector<Vector>& V, const std::vector<Face>& triangle, const Array<int>& order,
+	const std::vector<int>& source)
+{
+	count = (int)order.size();
+
+	//Extra zero slots let SIMD kernels load a full vector at the end of the table. A zero area triangle never hits
+	int size = count + TRI_LANES;
+	id.assign(size, -1);
+	for (int k = 0; k < 3; k++)
+	{
+		v0[k].assign(size, 0);
+		v1[k].assign(size, 0);
+		v2[k].assign(size, 0);
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		const Face& tri = triangle[order[i]];
+		const Vector& p0 = V[tri.v0];
+		const Vector& p1 = V[tri.v1];
+		const Vector& p2 = V[tri.v2];
+
+		id[i] = source[order[i]];
+		v0[0][i] = p0.a; v0[1][i] = p0.b; v0[2][i] = p0.c;
+		v1[0][i] = p1.a; v1[1][i] = p1.b; v1[2][i] = p1.c;
+		v2[0][i] = p2.a; v2[1][i] = p2.b; v2[2][i] = p2.c;
+	}
+}
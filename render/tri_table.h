@@ -0,0 +1,166 @@
+/* tri_table.h
+ * Triangle Table Library
+ *
+ * Purpose: To store every triangle where the inside test can stream it. Data is stored as a structure of arrays,
+ *          so the hot loop reads each value from its own contiguous array
+ *
+ * Assumptions: User builds the table after the BVH, in BVH leaf order, so a leaf covers a contiguous range of slots
+ */
+
+#pragma once
+
+#include <cmath>
+#include <utility>
+#include "render2.h"
+#include "array.h"
+
+#define TRI_LANES 8 //Widest SIMD kernel, arrays are padded by this many slots
+
+//Kernels that hit_leaf() can use, in order from slowest to fastest
+#define KERNEL_AUTO -1
+#define KERNEL_SCALAR 0
+#define KERNEL_SSE 1
+#define KERNEL_AVX2 2
+#define KERNEL_DOUBLE 3 //Scalar test in double, the reference for --precision double. Never picked by KERNEL_AUTO
+
+/* Declare Classes */
+
+//Class holds a ray set up for the watertight test. Axes are renamed so the ray runs along +z, then sheared so it becomes the z axis.
+//T is the scalar type the test runs in
+template <typename T>
+class TriRayT {
+public:
+	int kx, ky, kz; //Axis of the ray's largest component is kz, kx & ky are the other two in an order that keeps the winding
+	T cx, cy, cz; //Camera on the renamed axes
+	T sx, sy, sz; //Shear that turns the ray into <0,0,1>
+
+	/* Set up a ray once, before any triangle is tested
+	 * camera: Origin of the ray
+	 * dir: Direction of the ray, <image - camera>
+	 */
+	TriRayT(const Vec3<T>& camera, const Vec3<T>& dir)
+	{
+		T ax = std::fabs(dir.a), ay = std::fabs(dir.b), az = std::fabs(dir.c);
+		kz = (ax > ay) ? ((ax > az) ? 0 : 2) : ((ay > az) ? 1 : 2);
+		kx = (kz + 1) % 3;
+		ky = (kx + 1) % 3;
+		if (axis(dir, kz) < 0) std::swap(kx, ky); //Looking down -z mirrors the image, swap to undo it
+
+		cx = axis(camera, kx); cy = axis(camera, ky); cz = axis(camera, kz);
+		sz = (T)1 / axis(dir, kz);
+		sx = axis(dir, kx) * sz;
+		sy = axis(dir, ky) * sz;
+	}
+
+	/* Widen a float ray, so the same ray can be tested in double */
+	template <typename S>
+	explicit TriRayT(const TriRayT<S>& other) : kx(other.kx), ky(other.ky), kz(other.kz), cx(other.cx), cy(other.cy), cz(other.cz),
+		sx(other.sx), sy(other.sy), sz(other.sz) {}
+
+	/* Component k of a vector, 0 = a, 1 = b, 2 = c */
+	static T axis(const Vec3<T>& v, int k) { return (k == 0) ? v.a : ((k == 1) ? v.b : v.c); }
+};
+
+typedef TriRayT<float> TriRay; //What the BVH & kernels trace with
+
+/* Intersect a ray with one triangle, watertight barycentric test.
+ * Corners are moved into the ray's sheared space, where the ray is the z axis, and the 2D edge functions U, V, W
+ * say which side of each edge the ray passes. A shared edge gives exactly -U in the neighbor, so no ray slips between them.
+ * The distance is only divided out once the ray is known to be inside
+ * p0, p1, p2: Corners of the triangle, indexed by axis
+ * ray: Ray set up by TriRayT, in the same scalar type
+ * cull: 1 to skip triangles facing away from the camera
+ * t: Output distance along the ray, in units of <image - camera>, only assigned if the triangle is "seen"
+ * Return 1 if ray hits inside the triangle, 0 otherwise
+ */
+template <typename T>
+inline int watertight_hit(const T* p0, const T* p1, const T* p2, const TriRayT<T>& ray, int cull, T& t)
+{
+	//Corners relative to the camera, on the renamed axes
+	T az = p0[ray.kz] - ray.cz, bz = p1[ray.kz] - ray.cz, cz = p2[ray.kz] - ray.cz;
+	T ax = p0[ray.kx] - ray.cx - ray.sx * az, ay = p0[ray.ky] - ray.cy - ray.sy * az;
+	T bx = p1[ray.kx] - ray.cx - ray.sx * bz, by = p1[ray.ky] - ray.cy - ray.sy * bz;
+	T cx = p2[ray.kx] - ray.cx - ray.sx * cz, cy = p2[ray.ky] - ray.cy - ray.sy * cz;
+
+	//Edge functions, twice the signed area the ray makes with each edge. Edges count as inside
+	T U = cx * by - cy * bx;
+	T V = ax * cy - ay * cx;
+	if (cull ? (U < 0 || V < 0) : ((U < 0 || V < 0) && (U > 0 || V > 0))) return 0;
+	T W = bx * ay - by * ax;
+	if (cull ? (W < 0) : ((U < 0 || V < 0 || W < 0) && (U > 0 || V > 0 || W > 0))) return 0;
+
+	//Determinant is zero when the triangle is seen edge on
+	T det = U + V + W;
+	if (det == 0) return 0;
+
+	//Scaled distance, must be in front of the camera
+	T scaled = (U * az + V * bz + W * cz) * ray.sz;
+	if ((det > 0) ? (scaled <= 0) : (scaled >= 0)) return 0;
+
+	t = scaled / det;
+	return 1;
+}
+
+class TriTable;
+typedef void (*LeafKernel)(const TriTable& table, int first, int count, const TriRay& ray,
+	float& zBuffer, int& close_slot); //Tests every slot of a leaf, keeps the closest hit
+
+//Class holds the corners of every triangle, one array per corner & axis
+class TriTable {
+public:
+	int count; //Number of triangles in the table
+	int cull; //1 to skip triangles facing away from the camera
+	Array<int> id; //Index of the face in the .ply file, used for shading & tie breaks
+	Array<float> v0[3], v1[3], v2[3]; //Corners of each triangle, v0[0] holds the x of every v0, v0[1] the y & v0[2] the z
+
+	TriTable() : count(0), cull(0) { set_kernel(KERNEL_AUTO); }
+
+	/* Member Functions Declarations */
+	void build(const std::vector<Vector>& V, const std::vector<Face>& triangle, const Array<int>& order,
+		const std::vector<int>& source); //Fill table in the given order
+	int set_kernel(int kernel); //Pick scalar, SSE or AVX2 for hit_leaf(), returns the one the CPU can run
+
+	/* Test every triangle of a leaf, keep the closest hit. Ties go to the lowest face index
+	 * first: First slot of the leaf
+	 * count: Number of slots in the leaf
+	 * ray: Ray set up by TriRay
+	 * zBuffer: Closest distance so far, updated in place
+	 * close_slot: Slot of the closest face so far, updated in place. id[close_slot] is its face index
+	 */
+	void hit_leaf(int first, int count, const TriRay& ray, float& zBuffer, int& close_slot) const
+	{
+		leaf(*this, first, count, ray, zBuffer, close_slot);
+	}
+
+	/* Unit normal of the triangle in slot i, <v1-v0> x <v2-v0> scaled to length 1 */
+	Vector normal(int i) const
+	{
+		Vector e1(v1[0][i] - v0[0][i], v1[1][i] - v0[1][i], v1[2][i] - v0[2][i]);
+		Vector e2(v2[0][i] - v0[0][i], v2[1][i] - v0[1][i], v2[2][i] - v0[2][i]);
+		Vector N = e1.cross(e2);
+		float length = sqrtf(N.a * N.a + N.b * N.b + N.c * N.c);
+		return (length > 0) ? N * (1.0f / length) : N;
+	}
+
+	/* Intersect a ray with the triangle in slot i, watertight_hit() in the ray's scalar type. Corners are widened for double
+	 * i: Slot in the table
+	 * ray: Ray set up by TriRayT
+	 * t: Output distance along the ray, in units of <image - camera>, only assigned if the triangle is "seen"
+	 * Return 1 if ray hits inside the triangle, 0 otherwise
+	 */
+	template <typename T>
+	int hit(int i, const TriRayT<T>& ray, T& t) const
+	{
+		T p0[3] = { v0[0][i], v0[1][i], v0[2][i] };
+		T p1[3] = { v1[0][i], v1[1][i], v1[2][i] };
+		T p2[3] = { v2[0][i], v2[1][i], v2[2][i] };
+		return watertight_hit(p0, p1, p2, ray, cull, t);
+	}
+
+private:
+	LeafKernel leaf; //Kernel chosen by set_kernel()
+};
+
+/* Function Declarations */
+int kernel_detect(); //Find the fastest kernel this CPU can run
+const char* kernel_name(int kernel); //Name of a kernel, for printing